@@ -0,0 +1,245 @@
+#include <benchmark/benchmark.h>
+#include "block.h"
+#include "cpu_features.h"
+#include "corpus.h"
+
+namespace
+{
+    constexpr uint64_t corpus_size = 1024 * 1024;
+    constexpr uint64_t block_size = lzw::block_codec::block_size;
+
+    using namespace lzw::bench;
+
+    const std::vector<uint8_t> & corpus(const int64_t kind)
+    {
+        static const std::vector<std::vector<uint8_t>> corpora = []
+        {
+            std::vector<std::vector<uint8_t>> ret;
+            for (int64_t i = 0; i < CorpusCount; i++) ret.push_back(make_corpus(i, corpus_size));
+            return ret;
+        }();
+
+        return corpora[kind];
+    }
+
+    /// Run fn over every block of the selected corpus
+    template < typename Fn >
+    void for_each_block(const std::vector<uint8_t> & data, Fn && fn)
+    {
+        for (uint64_t offset = 0; offset < data.size(); offset += block_size) {
+            fn(std::span(data).subspan(offset, std::min(block_size, data.size() - offset)));
+        }
+    }
+
+    void corpus_args(benchmark::internal::Benchmark * bench)
+    {
+        for (int64_t i = 0; i < CorpusCount; i++) bench->Arg(i);
+    }
+}
+
+static void BM_BitWriterLSB(benchmark::State & state)
+{
+    const auto width = static_cast<uint64_t>(state.range(0));
+    constexpr uint64_t codes = 1 << 16;
+    std::vector<uint8_t> out;
+    for (auto _ : state)
+    {
+        out.clear();
+        lzw::BitWriterLSB writer(out);
+        for (uint64_t i = 0; i < codes; i++) {
+            writer.write(i, width);
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * codes * width / 8));
+}
+BENCHMARK(BM_BitWriterLSB)->Arg(1)->Arg(9)->Arg(12)->Arg(17)->Arg(32);
+
+static void BM_BitReaderLSB(benchmark::State & state)
+{
+    const auto width = static_cast<uint64_t>(state.range(0));
+    constexpr uint64_t codes = 1 << 16;
+    std::vector<uint8_t> in;
+    lzw::BitWriterLSB writer(in);
+    for (uint64_t i = 0; i < codes; i++) {
+        writer.write(i, width);
+    }
+
+    for (auto _ : state)
+    {
+        lzw::BitReaderLSB reader(in);
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < codes; i++) {
+            sum += reader.read(width);
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * codes * width / 8));
+}
+BENCHMARK(BM_BitReaderLSB)->Arg(1)->Arg(9)->Arg(12)->Arg(17)->Arg(32);
+
+static void BM_LZWCompress(benchmark::State & state)
+{
+    const auto & data = corpus(state.range(0));
+    lzw::lzw<12> codec;
+    std::vector<uint8_t> out;
+    for (auto _ : state)
+    {
+        for_each_block(data, [&](const std::span<const uint8_t> block) {
+            codec.compress(block, out);
+            benchmark::DoNotOptimize(out.data());
+        });
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * data.size()));
+    state.SetLabel(corpus_name[state.range(0)]);
+}
+BENCHMARK(BM_LZWCompress)->Apply(corpus_args);
+
+static void BM_LZWDecompress(benchmark::State & state)
+{
+    const auto & data = corpus(state.range(0));
+    lzw::lzw<12> codec;
+    std::vector<std::vector<uint8_t>> packed;
+    for_each_block(data, [&](const std::span<const uint8_t> block) {
+        codec.compress(block, packed.emplace_back());
+    });
+
+    std::vector<uint8_t> out;
+    for (auto _ : state)
+    {
+        for (const auto & block : packed) {
+            codec.decompress(block, out);
+            benchmark::DoNotOptimize(out.data());
+        }
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * data.size()));
+    state.SetLabel(corpus_name[state.range(0)]);
+}
+BENCHMARK(BM_LZWDecompress)->Apply(corpus_args);
+
+static void BM_HuffmanBuildTable(benchmark::State & state)
+{
+    const auto & data = corpus(state.range(0));
+    lzw::Huffman codec;
+    for (auto _ : state)
+    {
+        for_each_block(data, [&](const std::span<const uint8_t> block) {
+            benchmark::DoNotOptimize(codec.build_table(block));
+        });
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * data.size()));
+    state.SetLabel(corpus_name[state.range(0)]);
+}
+BENCHMARK(BM_HuffmanBuildTable)->Apply(corpus_args);
+
+static void BM_HuffmanEncode(benchmark::State & state)
+{
+    const auto & data = corpus(state.range(0));
+    const auto block = std::span(data).subspan(0, block_size);
+    lzw::Huffman codec;
+    if (codec.build_table(block) <= 1) {
+        state.SkipWithError("single symbol block has no code table");
+        return;
+    }
+
+    std::vector<uint8_t> out;
+    for (auto _ : state)
+    {
+        out.clear();
+        codec.encode(block, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * block.size()));
+    state.SetLabel(corpus_name[state.range(0)]);
+}
+BENCHMARK(BM_HuffmanEncode)->Apply(corpus_args);
+
+/// Generic kernel (0) against the one bound for this CPU (1)
+static void BM_Checksum(benchmark::State & state)
+{
+    const auto & data = corpus(1);
+    const auto features = state.range(0) ? lzw::cpu::detected() : lzw::cpu::features_t { };
+    const auto kernels = lzw::cpu::kernels_for(features);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(kernels.crc32(data, 0));
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * data.size()));
+    state.SetLabel(lzw::cpu::describe(features));
+}
+BENCHMARK(BM_Checksum)->Arg(0)->Arg(1);
+
+static void BM_HuffmanDecompress(benchmark::State & state)
+{
+    const auto & data = corpus(state.range(0));
+    lzw::Huffman codec;
+    std::vector<std::vector<uint8_t>> packed;
+    for_each_block(data, [&](const std::span<const uint8_t> block) {
+        codec.compress(block, packed.emplace_back());
+    });
+
+    std::vector<uint8_t> out;
+    for (auto _ : state)
+    {
+        for (const auto & block : packed) {
+            codec.decompress(block, out);
+            benchmark::DoNotOptimize(out.data());
+        }
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * data.size()));
+    state.SetLabel(corpus_name[state.range(0)]);
+}
+BENCHMARK(BM_HuffmanDecompress)->Apply(corpus_args);
+
+static void BM_BlockCompress(benchmark::State & state)
+{
+    const auto & data = corpus(state.range(0));
+    lzw::block_codec codec;
+    std::vector<uint8_t> out;
+    uint64_t packed_size = 0;
+    for (auto _ : state)
+    {
+        packed_size = 0;
+        for_each_block(data, [&](const std::span<const uint8_t> block) {
+            codec.compress(block, out);
+            packed_size += out.size() + sizeof(uint16_t);
+        });
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * data.size()));
+    state.counters["ratio"] = static_cast<double>(packed_size) / static_cast<double>(data.size());
+    state.SetLabel(corpus_name[state.range(0)]);
+}
+BENCHMARK(BM_BlockCompress)->Apply(corpus_args);
+
+static void BM_BlockDecompress(benchmark::State & state)
+{
+    const auto & data = corpus(state.range(0));
+    lzw::block_codec codec;
+    std::vector<std::vector<uint8_t>> packed;
+    for_each_block(data, [&](const std::span<const uint8_t> block) {
+        codec.compress(block, packed.emplace_back());
+    });
+
+    std::vector<uint8_t> out;
+    for (auto _ : state)
+    {
+        for (const auto & block : packed) {
+            codec.decompress(block, out);
+            benchmark::DoNotOptimize(out.data());
+        }
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * data.size()));
+    state.SetLabel(corpus_name[state.range(0)]);
+}
+BENCHMARK(BM_BlockDecompress)->Apply(corpus_args);
+
+BENCHMARK_MAIN();
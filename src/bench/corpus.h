@@ -0,0 +1,62 @@
+#ifndef LZW_BENCH_CORPUS_H
+#define LZW_BENCH_CORPUS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+/// Deterministic synthetic corpora shared by the benchmarks
+namespace lzw::bench
+{
+    enum corpus_t : int64_t { Random, Text, Zeros, Skewed, CorpusCount };
+    inline const char * corpus_name[] = { "random", "text", "zeros", "skewed" };
+
+    /// Generate a corpus
+    /// @param kind corpus_t
+    /// @param size Bytes to generate
+    /// @param chunk Chunk number, large corpora are generated chunk by chunk to keep memory usage low
+    /// @return Corpus data, identical for identical arguments
+    inline std::vector<uint8_t> make_corpus(const int64_t kind, const uint64_t size, const uint64_t chunk = 0)
+    {
+        std::mt19937_64 rng(0xC0DEC + kind + chunk * CorpusCount);
+        std::vector<uint8_t> data;
+        data.reserve(size);
+        switch (kind)
+        {
+            case Random:
+                while (data.size() < size) data.push_back(static_cast<uint8_t>(rng()));
+                break;
+            case Text:
+            {
+                const std::vector < std::string > words = {
+                    "the", "of", "and", "block", "dictionary", "code", "width", "stream", "huffman",
+                    "compress", "symbol", "table", "entry", "buffer", "thread", "worker", "\n" };
+                std::geometric_distribution<uint64_t> pick(0.18);
+                while (data.size() < size) {
+                    const auto & word = words[std::min<uint64_t>(pick(rng), words.size() - 1)];
+                    data.insert(data.end(), word.begin(), word.end());
+                    data.push_back(' ');
+                }
+                break;
+            }
+            case Zeros:
+                data.resize(size, 0);
+                break;
+            case Skewed:
+            {
+                std::geometric_distribution<uint32_t> pick(0.3);
+                while (data.size() < size) data.push_back(static_cast<uint8_t>(std::min<uint32_t>(pick(rng), 255)));
+                break;
+            }
+            default:
+                break;
+        }
+
+        data.resize(size);
+        return data;
+    }
+}
+
+#endif //LZW_BENCH_CORPUS_H
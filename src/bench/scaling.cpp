@@ -0,0 +1,276 @@
+/* scaling.cpp
+ *
+ * End-to-end throughput and scaling driver for the lzw binary.
+ * Runs compress and decompress over generated corpora for every combination of
+ * corpus, block size and thread count, and reports one row per run.
+ */
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <cstring>
+#include <spawn.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "args.h"
+#include "corpus.h"
+
+extern char ** environ;
+
+namespace utils = lzw::utils;
+
+utils::PreDefinedArgumentType::PreDefinedArgument MainArgument = {
+    { .short_name = 'h', .long_name = "help",        .argument_required = false, .description = "Show help" },
+    { .short_name = 'l', .long_name = "lzw",         .argument_required = true,  .description = "Path to the lzw binary (default: next to this executable)" },
+    { .short_name = 'T', .long_name = "threads",     .argument_required = true,  .description = "Maximum number of worker threads, runs 1, 2, 4 ... up to it" },
+    { .short_name = 'b', .long_name = "block-sizes", .argument_required = true,  .description = "Comma separated block sizes (default 4095,16383,32767)" },
+    { .short_name = 'c', .long_name = "corpora",     .argument_required = true,  .description = "Comma separated corpora: random,text,zeros,skewed (default all)" },
+    { .short_name = 's', .long_name = "size",        .argument_required = true,  .description = "Corpus size in MiB (default 64)" },
+    { .short_name = 'r', .long_name = "repeat",      .argument_required = true,  .description = "Repeat every run and keep the fastest (default 1)" },
+    { .short_name = 'f', .long_name = "format",      .argument_required = true,  .description = "Output format, csv or json (default csv)" },
+    { .short_name = 'o', .long_name = "output",      .argument_required = true,  .description = "Output file (default stdout)" },
+    { .short_name = 'w', .long_name = "workdir",     .argument_required = true,  .description = "Directory for corpora and intermediate files" },
+};
+
+struct run_result_t
+{
+    std::string corpus;
+    std::string mode;
+    uint64_t block_size = 0;
+    uint64_t threads = 0;
+    uint64_t input_bytes = 0;
+    uint64_t output_bytes = 0;
+    double seconds = 0;
+    double cpu_seconds = 0;
+    long peak_rss_kib = 0;
+    bool verified = false;
+};
+
+/// Run a command, discarding its output
+/// @param argv Command line
+/// @param usage Resource usage of the child
+/// @return Wall time in seconds
+/// @throws std::runtime_error Command could not be started or failed
+double run_command(const std::vector<std::string> & argv, rusage & usage)
+{
+    std::vector<char *> c_argv;
+    for (const auto & arg : argv) c_argv.push_back(const_cast<char *>(arg.c_str()));
+    c_argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    pid_t pid = 0;
+    const auto start = std::chrono::steady_clock::now();
+    const int err = posix_spawn(&pid, c_argv.front(), &actions, nullptr, c_argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0) {
+        throw std::runtime_error("Cannot start " + argv.front() + ": " + std::strerror(err));
+    }
+
+    int status = 0;
+    if (wait4(pid, &status, 0, &usage) == -1) {
+        throw std::runtime_error("wait4 failed: " + std::string(std::strerror(errno)));
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        throw std::runtime_error(argv.front() + " failed with status " + std::to_string(status));
+    }
+
+    return std::chrono::duration<double>(end - start).count();
+}
+
+std::vector<std::string> split(const std::string & list)
+{
+    std::vector<std::string> ret;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) ret.push_back(item);
+    }
+    return ret;
+}
+
+bool same_file(const std::filesystem::path & a, const std::filesystem::path & b)
+{
+    std::ifstream fa(a, std::ios::binary), fb(b, std::ios::binary);
+    std::vector<char> ba(1 << 20), bb(1 << 20);
+    while (fa && fb)
+    {
+        fa.read(ba.data(), static_cast<std::streamsize>(ba.size()));
+        fb.read(bb.data(), static_cast<std::streamsize>(bb.size()));
+        if (fa.gcount() != fb.gcount() || std::memcmp(ba.data(), bb.data(), fa.gcount()) != 0) return false;
+    }
+    return fa.eof() && fb.eof();
+}
+
+void print_results(std::ostream & os, const std::vector<run_result_t> & results, const bool json)
+{
+    auto mb_per_sec = [](const run_result_t & r) {
+        const auto plain = r.mode == "compress" ? r.input_bytes : r.output_bytes;
+        return static_cast<double>(plain) / (1024.0 * 1024.0) / r.seconds;
+    };
+
+    auto ratio = [](const run_result_t & r) {
+        return r.mode == "compress" ? static_cast<double>(r.output_bytes) / static_cast<double>(r.input_bytes)
+                                    : static_cast<double>(r.input_bytes) / static_cast<double>(r.output_bytes);
+    };
+
+    auto utilization = [](const run_result_t & r) {
+        return r.cpu_seconds / (r.seconds * static_cast<double>(r.threads));
+    };
+
+    if (!json)
+    {
+        os << "corpus,mode,block_size,threads,input_bytes,output_bytes,seconds,mb_per_sec,ratio,cpu_seconds,"
+              "utilization,peak_rss_kib,verified\n";
+        for (const auto & r : results)
+        {
+            os << r.corpus << "," << r.mode << "," << r.block_size << "," << r.threads << ","
+               << r.input_bytes << "," << r.output_bytes << "," << r.seconds << "," << mb_per_sec(r) << ","
+               << ratio(r) << "," << r.cpu_seconds << "," << utilization(r) << "," << r.peak_rss_kib << ","
+               << (r.verified ? "true" : "false") << "\n";
+        }
+        return;
+    }
+
+    os << "[\n";
+    for (uint64_t i = 0; i < results.size(); i++)
+    {
+        const auto & r = results[i];
+        os << "  { \"corpus\": \"" << r.corpus << "\", \"mode\": \"" << r.mode
+           << "\", \"block_size\": " << r.block_size << ", \"threads\": " << r.threads
+           << ", \"input_bytes\": " << r.input_bytes << ", \"output_bytes\": " << r.output_bytes
+           << ", \"seconds\": " << r.seconds << ", \"mb_per_sec\": " << mb_per_sec(r)
+           << ", \"ratio\": " << ratio(r) << ", \"cpu_seconds\": " << r.cpu_seconds
+           << ", \"utilization\": " << utilization(r) << ", \"peak_rss_kib\": " << r.peak_rss_kib
+           << ", \"verified\": " << (r.verified ? "true" : "false") << " }"
+           << (i + 1 == results.size() ? "\n" : ",\n");
+    }
+    os << "]\n";
+}
+
+int main(int argc, char ** argv)
+{
+    try
+    {
+        const utils::PreDefinedArgumentType PreDefinedArguments(MainArgument);
+        utils::ArgumentParser ArgumentParser(argc, argv, PreDefinedArguments);
+        const auto parsed = ArgumentParser.parse();
+        if (parsed.contains("help")) {
+            std::cout << *argv << " [Arguments [OPTIONS...]...]" << std::endl;
+            std::cout << PreDefinedArguments.print_help();
+            return EXIT_SUCCESS;
+        }
+
+        const auto lzw_binary = parsed.contains("lzw") ? std::filesystem::path(parsed.at("lzw"))
+            : std::filesystem::absolute(argv[0]).parent_path() / "lzw";
+        const uint64_t max_threads = parsed.contains("threads") ? std::strtoull(parsed.at("threads").c_str(), nullptr, 10)
+            : std::max(1u, std::thread::hardware_concurrency());
+        const uint64_t corpus_size = (parsed.contains("size") ? std::strtoull(parsed.at("size").c_str(), nullptr, 10) : 64) << 20;
+        const uint64_t repeat = std::max<uint64_t>(1, parsed.contains("repeat") ? std::strtoull(parsed.at("repeat").c_str(), nullptr, 10) : 1);
+        const bool json = parsed.contains("format") && parsed.at("format") == "json";
+        const auto workdir = parsed.contains("workdir") ? std::filesystem::path(parsed.at("workdir"))
+            : std::filesystem::temp_directory_path() / "lzw_scaling";
+        std::filesystem::create_directories(workdir);
+
+        std::vector<uint64_t> block_sizes;
+        for (const auto & size : split(parsed.contains("block-sizes") ? parsed.at("block-sizes") : "4095,16383,32767")) {
+            block_sizes.push_back(std::strtoull(size.c_str(), nullptr, 10));
+        }
+
+        std::vector<int64_t> corpora;
+        for (const auto & name : split(parsed.contains("corpora") ? parsed.at("corpora") : "random,text,zeros,skewed"))
+        {
+            const auto it = std::ranges::find_if(lzw::bench::corpus_name, [&](const char * n) { return name == n; });
+            if (it == std::end(lzw::bench::corpus_name)) throw std::invalid_argument("Unknown corpus " + name);
+            corpora.push_back(it - std::begin(lzw::bench::corpus_name));
+        }
+
+        std::vector<uint64_t> thread_counts;
+        for (uint64_t threads = 1; threads < max_threads; threads *= 2) thread_counts.push_back(threads);
+        thread_counts.push_back(std::max<uint64_t>(1, max_threads));
+
+        std::vector<run_result_t> results;
+        for (const auto kind : corpora)
+        {
+            const std::string name = lzw::bench::corpus_name[kind];
+            const auto plain = workdir / (name + ".bin");
+            const auto packed = workdir / (name + ".lzw");
+            const auto unpacked = workdir / (name + ".out");
+            {
+                // written in chunks: children are spawned from this process, so its footprint is the floor of their peak RSS
+                constexpr uint64_t chunk_size = 1 << 20;
+                std::ofstream corpus(plain, std::ios::binary);
+                for (uint64_t offset = 0, chunk = 0; offset < corpus_size; offset += chunk_size, chunk++)
+                {
+                    const auto data = lzw::bench::make_corpus(kind, std::min(chunk_size, corpus_size - offset), chunk);
+                    corpus.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+                }
+            }
+
+            for (const auto block_size : block_sizes)
+            {
+                for (const auto threads : thread_counts)
+                {
+                    auto measure = [&](const std::string & mode, const std::vector<std::string> & command,
+                        const std::filesystem::path & in, const std::filesystem::path & out)
+                    {
+                        run_result_t best { .corpus = name, .mode = mode, .block_size = block_size, .threads = threads };
+                        for (uint64_t i = 0; i < repeat; i++)
+                        {
+                            rusage usage { };
+                            const double seconds = run_command(command, usage);
+                            if (i == 0 || seconds < best.seconds)
+                            {
+                                best.seconds = seconds;
+                                best.cpu_seconds = static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+                                    + static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+                                best.peak_rss_kib = usage.ru_maxrss;
+                            }
+                        }
+                        best.input_bytes = std::filesystem::file_size(in);
+                        best.output_bytes = std::filesystem::file_size(out);
+                        return best;
+                    };
+
+                    const auto T = std::to_string(threads);
+                    auto compress = measure("compress", { lzw_binary.string(), "-i", plain.string(), "-o", packed.string(),
+                        "-T", T, "-B", std::to_string(block_size) }, plain, packed);
+                    auto decompress = measure("decompress", { lzw_binary.string(), "-d", "-i", packed.string(),
+                        "-o", unpacked.string(), "-T", T }, packed, unpacked);
+
+                    compress.verified = decompress.verified = same_file(plain, unpacked);
+                    std::cerr << name << " block " << block_size << " threads " << threads << ": "
+                              << (compress.verified ? "ok" : "MISMATCH") << std::endl;
+                    results.push_back(compress);
+                    results.push_back(decompress);
+                }
+            }
+
+            std::filesystem::remove(plain);
+            std::filesystem::remove(packed);
+            std::filesystem::remove(unpacked);
+        }
+
+        if (parsed.contains("output")) {
+            std::ofstream output(parsed.at("output"));
+            print_results(output, results, json);
+        } else {
+            print_results(std::cout, results, json);
+        }
+
+        return std::ranges::all_of(results, [](const run_result_t & r) { return r.verified; }) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    catch (std::exception & e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
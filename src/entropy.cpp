@@ -18,17 +18,22 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <barrier>
 #include <fstream>
 #include <iostream>
-#include <ranges>
 #include <thread>
 #include <cmath>
 #include <iomanip>
-#include <memory>
+#include <mutex>
+#include <vector>
+#include <sys/mman.h>
 #include "error.h"
 #include "args.h"
-#include "lzw6.h"
-#include <unordered_map>
+#include "mmap.h"
+#include "entropy.h"
 
 namespace utils = lzw::utils;
 
@@ -37,39 +42,116 @@ utils::PreDefinedArgumentType::PreDefinedArgument MainArgument = {
     { .short_name = 'v', .long_name = "version",    .argument_required = false, .description = "Show version" },
     { .short_name = 'i', .long_name = "input",      .argument_required = true,  .description = "Input file" },
     { .short_name = 'T', .long_name = "threads",    .argument_required = true,  .description = "Specify the number of worker threads" },
+    { .short_name = 'm', .long_name = "map",        .argument_required = true,  .description = "Write a per-block entropy and compressibility map to this file" },
+    { .short_name = 'b', .long_name = "block-size", .argument_required = true,  .description = "Map block size in bytes (default 4096)" },
+    { .short_name = 'f', .long_name = "format",     .argument_required = true,  .description = "Map format, csv or binary (default csv)" },
+    { .short_name = 'O', .long_name = "order",      .argument_required = true,  .description = "Highest context order to report, 0-2 (default 0). Order 2 needs 64 MiB per thread" },
 };
 
-long double entropy_of(const std::vector<uint8_t>& data, std::unordered_map <uint8_t, uint64_t> & frequency_map)
+using lzw::histogram_t;
+
+/// Per-block map of a whole file
+/// @param data Mapped file
+/// @param size File size
+/// @param block_size Bytes per map entry
+/// @param thread_count Worker threads
+/// @param binary Write map_header_t/map_record_t instead of CSV
+/// @param output Map destination
+/// @return Whole file histogram
+histogram_t write_block_map(const uint8_t * data, const uint64_t size, const uint64_t block_size,
+    const uint64_t thread_count, const bool binary, std::ostream & output)
 {
-    for (const auto & code : data) {
-        frequency_map[code]++;
+    constexpr uint64_t WINDOW_BLOCKS = 16384;
+    const uint64_t blocks = size / block_size + (size % block_size != 0);
+    std::vector < lzw::entropy::block_estimate_t > window(std::min(WINDOW_BLOCKS, blocks));
+    std::vector < histogram_t > partial_histograms(thread_count, histogram_t { });
+    std::atomic < uint64_t > cursor(0);
+    std::barrier sync(static_cast<std::ptrdiff_t>(thread_count + 1));
+
+    auto worker = [&](histogram_t * histogram)
+    {
+        lzw::entropy::block_model<> model;
+        for (uint64_t base = 0; base < blocks; base += WINDOW_BLOCKS)
+        {
+            const auto end = std::min(blocks, base + WINDOW_BLOCKS);
+            sync.arrive_and_wait();
+            for (uint64_t block; (block = cursor.fetch_add(1, std::memory_order_relaxed)) < end;)
+            {
+                const auto offset = block * block_size;
+                window[block - base] = model.analyze({ data + offset, std::min(block_size, size - offset) }, histogram);
+            }
+            sync.arrive_and_wait();
+        }
+    };
+
+    std::vector < std::thread > threads;
+    threads.reserve(thread_count);
+    for (uint64_t t = 0; t < thread_count; t++) {
+        threads.emplace_back(worker, &partial_histograms[t]);
     }
 
-    uint64_t total_tokens = 0;
-    for (const auto & freq: frequency_map | std::views::values) {
-        total_tokens += freq;
+    if (binary) {
+        const lzw::entropy::map_header_t header { .block_size = block_size, .file_size = size };
+        output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    } else {
+        output << "offset,size,order0,order1,lzw_ratio,huffman_ratio,suggestion\n" << std::fixed << std::setprecision(4);
+    }
+
+    for (uint64_t base = 0; base < blocks; base += WINDOW_BLOCKS)
+    {
+        const auto end = std::min(blocks, base + WINDOW_BLOCKS);
+        cursor = base;
+        sync.arrive_and_wait();
+        sync.arrive_and_wait();
+
+        for (uint64_t block = base; block < end; block++)
+        {
+            const auto & estimate = window[block - base];
+            if (binary)
+            {
+                const lzw::entropy::map_record_t record {
+                    .order0 = static_cast<float>(estimate.order0),
+                    .order1 = static_cast<float>(estimate.order1),
+                    .lzw_ratio = static_cast<float>(estimate.lzw_ratio),
+                    .huffman_ratio = static_cast<float>(estimate.huffman_ratio),
+                    .suggestion = estimate.suggestion,
+                    .reserved = { },
+                };
+                output.write(reinterpret_cast<const char *>(&record), sizeof(record));
+            }
+            else
+            {
+                const auto offset = block * block_size;
+                output << offset << ',' << std::min(block_size, size - offset) << ','
+                       << estimate.order0 << ',' << estimate.order1 << ','
+                       << estimate.lzw_ratio << ',' << estimate.huffman_ratio << ','
+                       << lzw::entropy::suggestion_name[estimate.suggestion] << '\n';
+            }
+        }
     }
 
-    std::vector < long double > EntropyList;
-    EntropyList.reserve(256);
-    for (const auto & freq: frequency_map | std::views::values) {
-        const auto prob = static_cast<long double>(freq) / static_cast<long double>(total_tokens);
-        EntropyList.push_back(prob * log2l(prob));
+    for (auto & thread: threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
     }
 
-    long double entropy = 0;
-    for (const auto & entropy_sig: EntropyList) {
-        entropy += entropy_sig;
+    histogram_t histogram { };
+    for (const auto & partial : partial_histograms)
+    {
+        for (int sym = 0; sym < 256; sym++) {
+            histogram[sym] += partial[sym];
+        }
     }
-    entropy = -entropy;
-    return entropy;
+
+    return histogram;
 }
 
 int main(const int argc, char **argv)
 {
-    constexpr int BLOCK_SIZE = 1024 * 256; // 256 KB
+    constexpr uint64_t CHUNK_SIZE = 1024 * 1024; // 1 MB
     try {
-        uint64_t thread_count = 1;
+        uint64_t thread_count = std::max(1u, std::thread::hardware_concurrency());
         const utils::PreDefinedArgumentType PreDefinedArguments(MainArgument);
         utils::ArgumentParser ArgumentParser(argc, argv, PreDefinedArguments);
         const auto parsed = ArgumentParser.parse();
@@ -91,70 +173,137 @@ int main(const int argc, char **argv)
         }
 
         if (parsed.contains("threads")) {
-            thread_count = std::strtoul(parsed.at("threads").c_str(), nullptr, 10);
+            thread_count = std::max(1ul, std::strtoul(parsed.at("threads").c_str(), nullptr, 10));
         }
 
-        auto build_frequency_map = [](const std::vector<uint8_t> * data, std::unordered_map <uint8_t, uint64_t> * frequency_map)
-        {
-            for (const auto & code : *data) {
-                (*frequency_map)[code]++;
+        uint64_t map_block_size = 4096;
+        if (parsed.contains("block-size")) {
+            map_block_size = std::strtoull(parsed.at("block-size").c_str(), nullptr, 10);
+            if (map_block_size == 0) {
+                throw std::invalid_argument("Map block size must be greater than 0");
             }
-        };
+        }
+
+        bool binary_map = false;
+        if (parsed.contains("format")) {
+            const auto format = parsed.at("format");
+            if (format != "csv" && format != "binary") {
+                throw std::invalid_argument("Unknown map format " + format);
+            }
+            binary_map = format == "binary";
+        }
+
+        uint64_t order = 0;
+        if (parsed.contains("order")) {
+            order = std::strtoull(parsed.at("order").c_str(), nullptr, 10);
+            if (order > 2) {
+                throw std::invalid_argument("Context order must be 0, 1 or 2");
+            }
+        }
 
-        if (parsed.contains("input"))
+        const auto input_file = parsed.at("input");
+        lzw::basic_io::mmap input_mmap(input_file, true);
+        const auto * data = reinterpret_cast<const uint8_t *>(input_mmap.data());
+        const uint64_t size = input_mmap.size();
+        ::madvise(input_mmap.data(), size, MADV_SEQUENTIAL);
+
+        if (parsed.contains("map"))
         {
-            const auto input_file = parsed.at("input");
-            std::ifstream input_file_stream(input_file, std::ios::binary);
-            if (!input_file_stream.is_open()) {
-                throw std::runtime_error("Failed to open input file " + input_file);
+            const auto map_file = parsed.at("map");
+            std::ofstream map_stream(map_file, std::ios::binary);
+            if (!map_stream) {
+                throw std::runtime_error("Failed to open map file " + map_file);
             }
 
-            std::unordered_map <uint8_t, uint64_t> all_frequency_map;
+            const auto histogram = write_block_map(data, size, map_block_size, thread_count, binary_map, map_stream);
+            std::cout << input_file << ": " << std::fixed << std::setprecision(4)
+                      << lzw::entropy::entropy_of(histogram) << std::endl;
+            return EXIT_SUCCESS;
+        }
+
+        // Persistent pool: each worker pulls chunks until the file is exhausted
+        // and keeps its own histogram, merged once at the end.
+        // Context counters are 32-bit per thread and folded into the shared 64-bit tables
+        // before they can overflow
+        const uint64_t chunks = size / CHUNK_SIZE + (size % CHUNK_SIZE != 0);
+        thread_count = std::min(thread_count, std::max<uint64_t>(chunks, 1));
+        std::atomic < uint64_t > next_chunk(0);
+        std::vector < histogram_t > partial_histograms(thread_count, histogram_t { });
+        std::vector < uint64_t > order1_counts(order >= 1 ? 1ull << 16 : 0, 0);
+        std::vector < uint64_t > order2_counts(order >= 2 ? 1ull << 24 : 0, 0);
+        std::mutex context_mutex;
+
+        auto fold = [&](std::vector<uint32_t> & local, std::vector<uint64_t> & shared)
+        {
+            for (uint64_t i = 0; i < local.size(); i++) {
+                shared[i] += local[i];
+            }
+            std::ranges::fill(local, 0);
+        };
 
-            while (!input_file_stream.eof())
+        std::vector < std::thread > threads;
+        threads.reserve(thread_count);
+        for (uint64_t t = 0; t < thread_count; t++)
+        {
+            threads.emplace_back([&](histogram_t * histogram)
             {
-                std::vector < std::vector <uint8_t> > data;
-                std::vector < std::thread > threads;
-                std::vector < std::unordered_map <uint8_t, uint64_t> > frequency_map;
-                for (int i = 0; i < thread_count; i++)
+                histogram_t local { };
+                std::vector < uint32_t > local_order1(order1_counts.size(), 0);
+                std::vector < uint32_t > local_order2(order2_counts.size(), 0);
+                uint64_t unfolded = 0;
+                auto fold_contexts = [&]
                 {
-                    std::vector <uint8_t> buffer;
-                    buffer.resize(BLOCK_SIZE);
-                    input_file_stream.read(reinterpret_cast<char *>(buffer.data()), BLOCK_SIZE);
-                    const auto actual = input_file_stream.gcount();
-                    if (actual == 0) {
-                        break;
-                    }
-                    buffer.resize(actual);
-                    data.emplace_back(std::move(buffer));
-                }
+                    std::lock_guard lock(context_mutex);
+                    if (order >= 1) fold(local_order1, order1_counts);
+                    if (order >= 2) fold(local_order2, order2_counts);
+                    unfolded = 0;
+                };
 
-                frequency_map.resize(data.size());
-                for (int i = 0; i < data.size(); i++) {
-                    threads.emplace_back(build_frequency_map, &data[i], &frequency_map[i]);
-                }
+                for (uint64_t chunk; (chunk = next_chunk.fetch_add(1, std::memory_order_relaxed)) < chunks;)
+                {
+                    const auto offset = chunk * CHUNK_SIZE;
+                    const auto end = std::min(offset + CHUNK_SIZE, size);
+                    lzw::cpu::kernels().histogram({ data + offset, end - offset }, local);
+                    if (order == 0) continue;
 
-                for (auto & thread: threads) {
-                    if (thread.joinable()) {
-                        thread.join();
+                    if (unfolded + CHUNK_SIZE > UINT32_MAX) {
+                        fold_contexts();
                     }
+
+                    lzw::entropy::accumulate_contexts<1>(data, offset, end, local_order1.data());
+                    if (order >= 2) lzw::entropy::accumulate_contexts<2>(data, offset, end, local_order2.data());
+                    unfolded += end - offset;
                 }
 
-                for (const auto & map: frequency_map)
-                {
-                    for (const auto & [sym, freq]: map) {
-                        all_frequency_map[sym] += freq;
-                    }
+                if (unfolded != 0) {
+                    fold_contexts();
                 }
-            }
 
-            std::cout << input_file << ": " << std::fixed << std::setprecision(4)
-                      << entropy_of({}, all_frequency_map) << std::endl;
+                *histogram = local;
+            }, &partial_histograms[t]);
+        }
 
-            return EXIT_SUCCESS;
+        for (auto & thread: threads) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+
+        histogram_t histogram { };
+        for (const auto & partial : partial_histograms)
+        {
+            for (int sym = 0; sym < 256; sym++) {
+                histogram[sym] += partial[sym];
+            }
         }
 
-         return EXIT_FAILURE;
+        std::cout << input_file << ": " << std::fixed << std::setprecision(4)
+                  << lzw::entropy::entropy_of(histogram);
+        if (order >= 1) std::cout << ", order-1: " << lzw::entropy::conditional_entropy_of(order1_counts);
+        if (order >= 2) std::cout << ", order-2: " << lzw::entropy::conditional_entropy_of(order2_counts);
+        std::cout << std::endl;
+
+        return EXIT_SUCCESS;
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
         return EXIT_FAILURE;
@@ -0,0 +1,138 @@
+#ifndef LZW_ARCHIVE_H
+#define LZW_ARCHIVE_H
+
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "pipeline.h"
+
+/// Archive of many files in one output:
+///     [HEADER][MEMBER CONTAINER]...[CENTRAL DIRECTORY][FOOTER]
+/// Every member is an ordinary block container, so it decodes on its own once its offset is known.
+/// The directory and footer sit at the end so members can be streamed out before their sizes are known
+namespace lzw::archive
+{
+    constexpr char magic[4] = { 'L', 'Z', 'W', 'A' };
+    constexpr uint32_t version = 1;
+
+    struct header_t {
+        char magic[4];
+        uint32_t version;
+    };
+
+    /// Last bytes of an archive, little endian
+    struct footer_t {
+        uint64_t directory_offset;  ///< Offset of the first directory entry
+        uint64_t member_count;
+        uint32_t directory_crc;     ///< CRC32 of the whole directory
+        char magic[4];
+    };
+
+    /// One directory entry, stored as
+    /// [UINT16: NAME SIZE][NAME][UINT64: ORIGINAL SIZE][UINT64: COMPRESSED SIZE][UINT64: OFFSET][UINT32: CRC32]
+    struct member_t
+    {
+        std::string name;
+        uint64_t original_size;
+        uint64_t compressed_size;
+        uint64_t offset;            ///< Offset of the member's first section header
+        uint32_t crc;               ///< CRC32 of the original data
+    };
+
+    /// CRC32 (ISO-HDLC) of data, continuing from prior
+    [[nodiscard]] uint32_t checksum(std::span<const uint8_t> data, uint32_t prior = 0);
+
+    /// Appends members to an archive stream, the directory is written by finish()
+    class writer
+    {
+    public:
+        /// Write the archive header
+        /// @param output Archive destination, must outlive the writer
+        /// @param block_size Bytes per block for members compressed by add()
+        /// @param group_blocks Blocks per shared-dictionary group for members compressed by add()
+        /// @throws std::invalid_argument Block size out of range
+        writer(std::ostream & output, uint64_t block_size, uint64_t group_blocks = 1);
+
+        writer(const writer &) = delete;
+        writer & operator=(const writer &) = delete;
+
+        /// Compress data with every pipeline worker and append it as a member
+        /// @param pipeline Pipeline running the compression
+        /// @param name Member name, unique within the archive
+        /// @param data Member contents
+        /// @throws std::invalid_argument Duplicate or overlong name
+        void add(block_pipeline & pipeline, std::string name, std::span<const uint8_t> data);
+
+        /// Append a member compressed elsewhere, for instance by block_pipeline::compress_on
+        /// @param name Member name, unique within the archive
+        /// @param original_size Size of the data before compression
+        /// @param crc checksum() of the data before compression
+        /// @param container Block container of the data
+        /// @throws std::invalid_argument Duplicate or overlong name
+        void add_container(std::string name, uint64_t original_size, uint32_t crc, std::span<const uint8_t> container);
+
+        /// Write the central directory and footer, no member can be added afterwards
+        void finish();
+
+        [[nodiscard]] const std::vector<member_t> & members() const noexcept { return members_; }
+
+    private:
+        std::ostream & output_;
+        uint64_t block_size_;
+        uint64_t group_blocks_;
+        uint64_t offset_ = sizeof(header_t);
+        std::vector<member_t> members_;
+        std::unordered_map<std::string, uint64_t> names_;
+        bool finished_ = false;
+
+        void check_name(const std::string & name);
+    };
+
+    /// Reads the directory of a mapped archive and extracts single members without touching the others
+    class reader
+    {
+    public:
+        /// Parse the footer and central directory
+        /// @param archive Whole archive, must outlive the reader
+        /// @throws std::runtime_error Not an archive, or corrupted directory
+        explicit reader(std::span<const uint8_t> archive);
+
+        reader(const reader &) = delete;
+        reader & operator=(const reader &) = delete;
+
+        [[nodiscard]] const std::vector<member_t> & members() const noexcept { return members_; }
+
+        /// Look a member up by name
+        /// @return The member, nullptr if there is none by that name
+        [[nodiscard]] const member_t * find(std::string_view name) const;
+
+        /// Decompress only the blocks of one member and verify its checksum
+        /// @param pipeline Pipeline running the decompression
+        /// @param member Member of this archive
+        /// @param output Destination
+        /// @return Bytes written
+        /// @throws std::runtime_error Corrupted member or checksum mismatch
+        uint64_t extract(block_pipeline & pipeline, const member_t & member, std::ostream & output) const;
+
+        /// Decompress one member entirely on the calling worker, replacing the contents of output
+        /// @param worker Worker running the calling task
+        /// @throws std::runtime_error Corrupted member or checksum mismatch
+        void extract_on(block_pipeline & pipeline, uint64_t worker, const member_t & member, std::vector<uint8_t> & output) const;
+
+        /// Compressed container of one member
+        [[nodiscard]] std::span<const uint8_t> container(const member_t & member) const {
+            return archive_.subspan(member.offset, member.compressed_size);
+        }
+
+    private:
+        std::span<const uint8_t> archive_;
+        std::vector<member_t> members_;
+        std::unordered_map<std::string_view, uint64_t> names_;
+    };
+}
+
+#endif //LZW_ARCHIVE_H
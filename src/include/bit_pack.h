@@ -0,0 +1,112 @@
+#ifndef LZW_BIT_PACK_H
+#define LZW_BIT_PACK_H
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+namespace lzw
+{
+    /// Code table entries of pack_codes() are code | length << CodeLengthShift, one load per symbol
+    constexpr uint64_t CodeLengthShift = 58;
+
+    /// Bit accumulator of the code packing kernels. Whole bytes leave with one unaligned 64-bit store,
+    /// so fewer than 8 bits stay pending and the output needs 8 bytes of slack
+    struct code_packer_t
+    {
+        uint8_t * out;
+        uint64_t acc;
+        uint64_t fill;
+    };
+
+    [[gnu::always_inline]] inline void flush_bytes(uint8_t *& out, uint64_t & acc, uint64_t & fill)
+    {
+        uint64_t word = acc;
+        if constexpr (std::endian::native == std::endian::big) word = std::byteswap(word);
+        std::memcpy(out, &word, sizeof(word));
+        out += fill >> 3;
+        acc >>= fill & ~7ull;
+        fill &= 7;
+    }
+
+    /// Pack src adding Symbols codes between two flushes, Symbols times the longest code must fit 56 bits
+    template < uint64_t Symbols >
+    [[gnu::always_inline]] inline void pack_code_groups(const std::span<const uint8_t> src, const uint64_t * table,
+        code_packer_t & packer)
+    {
+        constexpr uint64_t CodeMask = (1ULL << CodeLengthShift) - 1;
+        const uint8_t * in = src.data();
+        const uint64_t size = src.size();
+        uint8_t * out = packer.out;
+        uint64_t acc = packer.acc, fill = packer.fill;
+        uint64_t i = 0;
+        for (; i + Symbols <= size; i += Symbols)
+        {
+            // the group is packed on its own first, so only one shift per group waits on fill
+            uint64_t group = 0, group_length = 0;
+            for (uint64_t k = 0; k < Symbols; k++)
+            {
+                const uint64_t entry = table[in[i + k]];
+                group |= (entry & CodeMask) << group_length;
+                group_length += entry >> CodeLengthShift;
+            }
+
+            acc |= group << fill;
+            fill += group_length;
+            flush_bytes(out, acc, fill);
+        }
+
+        for (; i < size; i++)
+        {
+            const uint64_t entry = table[in[i]];
+            acc |= (entry & CodeMask) << fill;
+            fill += entry >> CodeLengthShift;
+            flush_bytes(out, acc, fill);
+        }
+
+        packer = { .out = out, .acc = acc, .fill = fill };
+    }
+
+    /// Pack src with codes longer than 56 bits, which go out in two halves
+    [[gnu::always_inline]] inline void pack_wide_codes(const std::span<const uint8_t> src, const uint64_t * table,
+        code_packer_t & packer)
+    {
+        uint8_t * out = packer.out;
+        uint64_t acc = packer.acc, fill = packer.fill;
+        for (const auto c : src)
+        {
+            const uint64_t length = table[c] >> CodeLengthShift;
+            const uint64_t code = table[c] & ((1ULL << CodeLengthShift) - 1);
+            const uint64_t low = std::min<uint64_t>(length, 32);
+            acc |= (code & ((1ULL << low) - 1)) << fill;
+            fill += low;
+            flush_bytes(out, acc, fill);
+            acc |= (code >> low) << fill;
+            fill += length - low;
+            flush_bytes(out, acc, fill);
+        }
+
+        packer = { .out = out, .acc = acc, .fill = fill };
+    }
+
+    /// Append the code of every symbol of src to the packer, least significant bit first, picking the
+    /// kernel that packs the most codes per flush for the longest code of the table.
+    /// Generic body of cpu::kernels().pack_codes, compiled again per instruction set
+    /// @param src Symbols
+    /// @param table Code table, code | length << CodeLengthShift for each of the 256 symbols
+    /// @param longest Longest code length in table, at most 58
+    /// @param packer Output state, out needs room for src.size() * longest bits plus 8 bytes
+    [[gnu::always_inline]] inline void pack_codes(const std::span<const uint8_t> src, const uint64_t * table,
+        const uint64_t longest, code_packer_t & packer)
+    {
+        if (longest <= 14) pack_code_groups<4>(src, table, packer);
+        else if (longest <= 18) pack_code_groups<3>(src, table, packer);
+        else if (longest <= 28) pack_code_groups<2>(src, table, packer);
+        else if (longest <= 56) pack_code_groups<1>(src, table, packer);
+        else pack_wide_codes(src, table, packer);
+    }
+}
+
+#endif //LZW_BIT_PACK_H
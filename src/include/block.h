@@ -0,0 +1,202 @@
+#ifndef LZW_BLOCK_H
+#define LZW_BLOCK_H
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <tuple>
+#include <vector>
+#include "lzw6.h"
+#include "lz77.h"
+#include "dictionary.h"
+#include "entropy.h"
+#include "stats.h"
+
+namespace lzw
+{
+    /// Container section header, little endian, followed by section_size bytes of [SIGNATURE][PAYLOAD]
+    struct section_head_16bit_t {
+        uint16_t section_size;
+    };
+
+    /// Optional container header, present when the blocks need a preset dictionary or a compression level was given.
+    /// Byte 2 is never a block signature, which tells it apart from a first section header
+    struct stream_header_t
+    {
+        char magic[3];
+        uint8_t version;
+        uint32_t dictionary_id;     ///< Dictionary the blocks need, if flags has HasDictionary
+        uint8_t flags;
+        uint8_t level;              ///< Compression level 1 to 9 the stream was written at, 0 if none was given
+        uint16_t reserved;
+
+        static constexpr char Magic[3] = { 'L', 'Z', '#' };
+        static constexpr uint8_t Version = 2;
+        static constexpr uint8_t HasDictionary = 1;
+        /// Version 1 headers end after dictionary_id and always name a dictionary
+        static constexpr uint64_t Version1Size = 8;
+    };
+
+    /// Read the stream header at the start of a container, if there is one
+    /// @param container Whole container
+    /// @param header Filled if a header is present, version 1 headers as if they were current
+    /// @return Size of the header, 0 if there is none
+    /// @throws std::runtime_error Header of an unsupported version
+    uint64_t read_stream_header(std::span<const uint8_t> container, stream_header_t & header);
+
+    /// Location of one compressed block inside a container
+    struct block_ref_t
+    {
+        uint64_t offset; ///< Offset of the [SIGNATURE][PAYLOAD] section, past its 16-bit size header
+        uint64_t size;   ///< Section size
+    };
+
+    /// Walk the [UINT16: SIZE][SECTION] headers of a container without decoding any block
+    /// @param container Whole container
+    /// @param index Filled with every block in stream order, its capacity is reused
+    /// @throws std::runtime_error Truncated container
+    void index_blocks(std::span<const uint8_t> container, std::vector<block_ref_t> & index);
+
+    /// Which codecs block_codec::compress() runs on a block
+    enum class selection_t
+    {
+        Exhaustive, ///< LZW, Huffman and LZ77 if enabled, the smallest output is kept
+        Guided,     ///< Huffman, or LZ77 if enabled and LZW otherwise, picked from the order-0 entropy and the repeats of the block
+    };
+
+    /// Block codec used by the lzw container. Every block is compressed by both LZW, in the chosen growth
+    /// variant, and Huffman and the smaller result is kept behind a one byte signature, unless the guided
+    /// selection runs only the codec the block's entropy points to.
+    /// Blocks using few distinct symbols run classic LZW over their symbol ranks instead, starting from
+    /// a dictionary of only those symbols with narrower codes: [SIGNATURE 'A'][32 BYTE SYMBOL BITMAP][LZW STREAM]
+    /// With LZ77 enabled it is tried as well, its matches reach back into the blocks of the group since the
+    /// last block that starts one. Blocks no codec shrinks are stored as they are: [SIGNATURE 'S'][DATA]
+    /// Construct one per thread and reuse it, dictionaries and buffers survive between blocks.
+    class block_codec
+    {
+    public:
+        static constexpr uint64_t bit_size = 12;
+        static constexpr uint64_t block_size = const_two_power(bit_size) - 1;
+        /// Largest block whose Huffman fallback (8 bits per symbol at worst, plus table) still fits a 16-bit section
+        static constexpr uint64_t max_block_size = 0xFFFF - 0x600;
+        static constexpr char LZWSignature = 'L';
+        static constexpr char HuffmanSignature = 'H';
+        static constexpr char LZMWSignature = 'M';
+        static constexpr char LZAPSignature = 'P';
+        static constexpr char AlphabetSignature = 'A';
+        static constexpr char LZ77Signature = 'Z';
+        /// LZ77 block whose matches may reach into the blocks before it, back to the last block starting a group
+        static constexpr char LZ77ContinuedSignature = 'W';
+        static constexpr char StoredSignature = 'S';
+        /// Most distinct symbols of a block run over its alphabet, more would need the full 8-bit code size
+        static constexpr uint64_t max_alphabet = 128;
+        static constexpr uint64_t alphabet_bitmap_size = 256 / 8;
+        /// LZW block continuing the dictionary, the growth variant and the alphabet of the block before it. Every other
+        /// signature starts a new group, which decodes independently of the blocks before it
+        static constexpr char LZWContinuedSignature = 'C';
+
+        block_codec() = default;
+        block_codec(const block_codec &) = delete;
+        block_codec & operator=(const block_codec &) = delete;
+
+        /// Compress one block into dst as [SIGNATURE][PAYLOAD], dst is overwritten
+        /// @param src Block data
+        /// @param dst Output buffer, its capacity is reused
+        /// @param carry Continue the LZW dictionary of the previous block of this group if that block was kept as LZW
+        /// @return Signature of the codec that was kept
+        char compress(std::span<const uint8_t> src, std::vector<uint8_t> & dst, bool carry = false);
+
+        /// Decompress one [SIGNATURE][PAYLOAD] block into dst, dst is overwritten.
+        /// Blocks of a group must be decompressed in order by the same codec
+        /// @param src Compressed block
+        /// @param dst Output buffer, its capacity is reused
+        /// @throws std::runtime_error, std::invalid_argument, std::out_of_range Corrupted block
+        void decompress(std::span<const uint8_t> src, std::vector<uint8_t> & dst);
+
+        /// Start a new group, the next block neither continues nor may continue an earlier dictionary
+        void begin_group() noexcept { lzw_carry_ = 0; lzw_decoded_ = 0; alphabet_outgrown_ = false; lz77_carry_ = false; lz77_.reset(); }
+
+        /// Whether a block of this signature can be decoded without the blocks before it
+        [[nodiscard]] static bool starts_group(const char signature) noexcept {
+            return signature != LZWContinuedSignature && signature != LZ77ContinuedSignature;
+        }
+
+        /// Whether a section can be decoded without the blocks before it
+        [[nodiscard]] static bool starts_group(const std::span<const uint8_t> section) noexcept {
+            return section.empty() || starts_group(static_cast<char>(section.front()));
+        }
+
+        /// Drop per-block state and scratch contents, allocations are kept
+        void reset();
+
+        /// Start every block from a trained dictionary, nullptr returns to the built-in start.
+        /// Blocks must be decompressed with the same dictionary they were compressed with. Its phrases span every
+        /// byte value, so blocks are not run over their alphabet while one is set
+        /// @param dictionary Dictionary to use, must outlive its use by the codec
+        /// @throws std::invalid_argument, std::runtime_error The dictionary does not fit this codec
+        void set_dictionary(const dictionary_t * dictionary);
+
+        /// Choose what LZW does once a block fills its dictionary, decompression does not depend on it
+        void set_reset_policy(reset_policy_t policy) noexcept;
+
+        /// Choose the LZW variant following blocks are compressed with, decompression follows the signatures
+        void set_growth(const growth_t growth) noexcept { growth_ = growth; begin_group(); }
+
+        /// Also try LZ77 on following blocks, decompression follows the signatures
+        /// @param mode Match finder, Off to not try LZ77
+        /// @param window_log Matches reach back up to 2^window_log bytes
+        /// @throws std::invalid_argument window_log is out of the range lz77 supports
+        void set_lz77(lz77_mode_t mode, uint64_t window_log = lz77::DefaultWindowLog);
+
+        /// Whether decompress() keeps the output of every codec as LZ77 history. Only continued LZ77 blocks
+        /// read it, so callers that can see a group's signatures ahead turn it off for groups without one
+        void set_lz77_history(const bool keep) noexcept { keep_lz77_history_ = keep; }
+
+        /// Choose which codecs following blocks are tried with, decompression follows the signatures
+        void set_selection(const selection_t selection) noexcept { selection_ = selection; begin_group(); }
+
+        /// Record per-stage timing into stats, nullptr disables recording
+        void set_stats(stats::thread_stats_t * stats) noexcept { stats_ = stats; }
+
+    private:
+        /// Classic LZW over symbol ranks, one per initial code size from 2 to 7 bits. Tables are allocated on first use
+        template < uint64_t CodeSize >
+        using alphabet_lzw = lzw<bit_size, false, CodeSize>;
+
+        lzw<bit_size> lzw_;
+        lzmw<bit_size> lzmw_;
+        lzap<bit_size> lzap_;
+        std::tuple < alphabet_lzw<2>, alphabet_lzw<3>, alphabet_lzw<4>, alphabet_lzw<5>, alphabet_lzw<6>, alphabet_lzw<7> > alphabet_lzw_;
+        growth_t growth_ = growth_t::Classic;
+        bool has_dictionary_ = false;
+        Huffman huffman_;
+        lz77 lz77_;
+        lz77_mode_t lz77_mode_ = lz77_mode_t::Off;
+        selection_t selection_ = selection_t::Exhaustive;
+        entropy::repeat_probe repeat_probe_;
+        std::array<uint8_t, alphabet_bitmap_size> encoder_alphabet_ { }; ///< Symbol bitmap of the alphabet group being compressed
+        std::array<uint8_t, 256> encoder_rank_ { };                     ///< Rank of each symbol within that alphabet
+        std::array<uint8_t, 256> decoder_symbols_ { };                  ///< Symbol of each rank of the alphabet group being decompressed
+        uint64_t decoder_alphabet_size_ = 0;
+        std::vector<uint8_t> input_ranks_;
+        std::vector<uint8_t> output_lzw_;
+        std::vector<uint8_t> output_huffman_;
+        std::vector<uint8_t> output_lz77_;
+        stats::thread_stats_t * stats_ = nullptr;
+        char lzw_carry_ = 0;        ///< Signature starting the group of the last block compressed if it was kept as LZW, 0 otherwise
+        char lzw_decoded_ = 0;      ///< Signature starting the group of the last block decompressed if it was LZW, 0 otherwise
+        bool alphabet_outgrown_ = false; ///< A block of this group used symbols outside the alphabet group before it
+        bool lz77_carry_ = false;   ///< LZ77 has the blocks of this group compressed so far in its history
+        bool keep_lz77_history_ = true; ///< Blocks decompressed by other codecs join the LZ77 history
+
+        /// Whether the guided selection expects a dictionary codec to beat Huffman on src
+        /// @param huffman_bytes Size of the Huffman output, from its table
+        bool guide_to_dictionary(std::span<const uint8_t> src, uint64_t huffman_bytes);
+
+        /// Call call(codec) with the alphabet codec for an alphabet of symbols distinct symbols
+        template < typename Call >
+        void with_alphabet_lzw(uint64_t symbols, Call && call);
+    };
+}
+
+#endif //LZW_BLOCK_H
@@ -0,0 +1,65 @@
+#ifndef LZW_CPU_FEATURES_H
+#define LZW_CPU_FEATURES_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include "bit_pack.h"
+#include "histogram.h"
+
+/// Instruction set detection and the kernel table bound from it. Every kernel has a generic version,
+/// so all of them work on any CPU; the features only pick faster copies. The table is bound once on
+/// first use, or again by restrict_to(), which must run before any worker thread starts
+namespace lzw::cpu
+{
+    /// Instruction set extensions the kernels can use
+    struct features_t
+    {
+        bool sse42 = false;
+        bool pclmul = false;        ///< Carry-less multiply, folds the CRC
+        bool avx2 = false;
+        bool bmi2 = false;          ///< shlx/shrx, shifts by a register without touching the flags
+        bool avx512 = false;        ///< AVX-512 F and BW
+
+        bool operator==(const features_t &) const = default;
+    };
+
+    /// Kernels the hot paths call through. The CRC folds with pclmul, code packing takes bmi2 shifts;
+    /// avx2 and avx512 are detected and reported, no kernel has a faster copy for them yet
+    struct kernels_t
+    {
+        /// accumulate_histogram()
+        void (*histogram)(std::span<const uint8_t> data, histogram_t & histogram);
+
+        /// CRC32 (ISO-HDLC) of data, continuing from prior
+        uint32_t (*crc32)(std::span<const uint8_t> data, uint32_t prior);
+
+        /// pack_codes()
+        void (*pack_codes)(std::span<const uint8_t> src, const uint64_t * table, uint64_t longest, code_packer_t & packer);
+    };
+
+    /// Features of the CPU this process runs on, as far as the OS enables them
+    [[nodiscard]] const features_t & detected();
+
+    /// Features the bound kernels use, detected() unless restricted
+    [[nodiscard]] const features_t & active();
+
+    /// Kernels bound for active()
+    [[nodiscard]] const kernels_t & kernels();
+
+    /// Kernels for a feature set, whether or not this CPU has it
+    [[nodiscard]] kernels_t kernels_for(const features_t & features);
+
+    /// Restrict the kernels to a feature list and bind them again
+    /// @param list Comma separated names out of sse4.2, pclmul, avx2, bmi2 and avx512,
+    ///     "none" for the generic kernels, or "native" for everything detected
+    /// @throws std::invalid_argument Unknown feature name
+    /// @throws std::runtime_error A listed feature is not available on this CPU
+    void restrict_to(std::string_view list);
+
+    /// Comma separated names of the features, "none" if there are none
+    [[nodiscard]] std::string describe(const features_t & features);
+}
+
+#endif //LZW_CPU_FEATURES_H
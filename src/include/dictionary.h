@@ -0,0 +1,41 @@
+#ifndef LZW_DICTIONARY_H
+#define LZW_DICTIONARY_H
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace lzw
+{
+    /// Pre-trained state both ends of a stream start every block from: LZW phrases seeded after the
+    /// single symbols, and Huffman code lengths a block can use instead of storing its own table.
+    /// Streams name the dictionary they need by id
+    struct dictionary_t
+    {
+        uint32_t id = 0;                              ///< CRC32 of the serialized contents
+        std::vector < uint32_t > lzw_prefix;          ///< Phrase i extends code lzw_prefix[i] ...
+        std::vector < uint8_t > lzw_suffix;           ///< ... by symbol lzw_suffix[i], and gets code 258 + i
+        std::array < uint8_t, 256 > huffman_lengths { }; ///< Canonical code length per symbol
+    };
+
+    /// Build a dictionary from sample data
+    /// @param samples Sample messages, each one parsed the way the codec parses a block
+    /// @param block_size Samples are split into blocks of this size first
+    /// @param max_phrases LZW phrases to keep, including the prefixes they need
+    /// @return Dictionary with its id set
+    /// @throws std::invalid_argument max_phrases does not fit the 12-bit dictionary
+    dictionary_t train_dictionary(std::span<const std::span<const uint8_t>> samples, uint64_t block_size, uint64_t max_phrases);
+
+    /// Write a dictionary file
+    /// [MAGIC "LZWD"][UINT32: VERSION][UINT32: ID][UINT16: PHRASES][[UINT16: PREFIX][UINT8: SUFFIX]...][256 x UINT8: LENGTHS]
+    /// @throws std::runtime_error Cannot write the file
+    void save_dictionary(const dictionary_t & dictionary, const std::string & path);
+
+    /// Read and validate a dictionary file
+    /// @throws std::runtime_error Cannot read the file, or it is not a dictionary or corrupted
+    [[nodiscard]] dictionary_t load_dictionary(const std::string & path);
+}
+
+#endif //LZW_DICTIONARY_H
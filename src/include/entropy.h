@@ -0,0 +1,344 @@
+#ifndef LZW_ENTROPY_H
+#define LZW_ENTROPY_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+#include "cpu_features.h"
+#include "lzw6.h"
+
+/// Entropy and compressibility estimates used to pre-screen data before compressing it
+namespace lzw::entropy
+{
+    /// c * log2(c), 0 for c == 0
+    inline long double count_log_count(const uint64_t count)
+    {
+        return count == 0 ? 0 : static_cast<long double>(count) * log2l(static_cast<long double>(count));
+    }
+
+    /// Order-0 Shannon entropy
+    /// @return Bits per symbol
+    inline long double entropy_of(const histogram_t & histogram)
+    {
+        uint64_t total_tokens = 0;
+        for (const auto & freq : histogram) {
+            total_tokens += freq;
+        }
+
+        long double entropy = 0;
+        for (const auto & freq : histogram)
+        {
+            if (freq == 0) continue;
+            const auto prob = static_cast<long double>(freq) / static_cast<long double>(total_tokens);
+            entropy += prob * log2l(prob);
+        }
+
+        return -entropy;
+    }
+
+    /// Count every (previous Order bytes, byte) pair of data[begin, end) into counts[context << 8 | byte].
+    /// Context is read from before begin, so chunks can be counted independently without seams.
+    /// @tparam Order Context length in bytes, the table has 256^(Order + 1) counters
+    /// @param data Whole input
+    /// @param begin First position counted
+    /// @param end One past the last position counted
+    /// @param counts Flat counter table
+    template < uint64_t Order >
+    requires (Order >= 1 && Order <= 2)
+    void accumulate_contexts(const uint8_t * data, const uint64_t begin, const uint64_t end, uint32_t * counts)
+    {
+        constexpr uint32_t ContextMask = (1u << (8 * Order)) - 1;
+        const uint64_t first = std::max(begin, Order);
+        if (first >= end) return;
+
+        uint32_t context = 0;
+        for (uint64_t i = first - Order; i < first; i++) {
+            context = (context << 8) | data[i];
+        }
+
+        for (uint64_t i = first; i < end; i++)
+        {
+            counts[(context << 8) | data[i]]++;
+            context = ((context << 8) | data[i]) & ContextMask;
+        }
+    }
+
+    /// Conditional entropy H(X | context) from a flat [context << 8 | byte] table
+    /// @return Bits per byte
+    inline long double conditional_entropy_of(const std::vector<uint64_t> & counts)
+    {
+        auto clc = [](const uint64_t c) { return c == 0 ? 0.0 : static_cast<double>(c) * std::log2(static_cast<double>(c)); };
+        long double joint = 0, contexts = 0;
+        uint64_t total = 0;
+        for (uint64_t context = 0; context < counts.size(); context += 256)
+        {
+            uint64_t context_total = 0;
+            for (uint64_t sym = 0; sym < 256; sym++)
+            {
+                context_total += counts[context + sym];
+                joint += clc(counts[context + sym]);
+            }
+
+            contexts += clc(context_total);
+            total += context_total;
+        }
+
+        return total == 0 ? 0 : (contexts - joint) / static_cast<long double>(total);
+    }
+
+    /// Codec a block is expected to do best with, a hint from the estimates below that
+    /// block_codec may overrule since it measures its real candidates
+    enum suggestion_t : uint8_t { Store, LZW, Huffman };
+    inline const char * suggestion_name[] = { "store", "lzw", "huffman" };
+
+    /// Per-block estimates
+    struct block_estimate_t
+    {
+        double order0 = 0;       ///< Order-0 entropy, bits per byte
+        double order1 = 0;       ///< Previous-byte conditioned entropy, bits per byte
+        double lzw_ratio = 0;    ///< Approximate LZW output / input, see block_model::lzw_bits
+        double huffman_ratio = 0;///< Estimated Huffman output / input, table included
+        suggestion_t suggestion = Store;
+    };
+
+    /// Repeats a block has within itself
+    struct repeat_estimate_t
+    {
+        uint64_t covered = 0;   ///< Bytes inside repeats
+        uint64_t matches = 0;   ///< Repeats found
+    };
+
+    /// Repeat finder keeping one 4-byte candidate per hash, the cheapest look at what LZ77 and LZW would
+    /// gain over order-0 coding. Construct one per thread and reuse it
+    class repeat_probe
+    {
+        static constexpr uint64_t MinMatch = 4;
+        static constexpr uint64_t HashBits = 12;
+
+        std::vector < uint32_t > table_ = std::vector<uint32_t>(1ull << HashBits, 0); ///< Position + 1 of the latest word per hash
+
+        static uint32_t load32(const uint8_t * data)
+        {
+            uint32_t value;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+
+    public:
+        /// Find the repeats of data, each one extended as far as it goes and skipped over
+        [[nodiscard]] repeat_estimate_t measure(const std::span<const uint8_t> data)
+        {
+            repeat_estimate_t ret;
+            if (data.size() < MinMatch) return ret;
+
+            std::ranges::fill(table_, 0);
+            for (uint64_t i = 0; i + MinMatch <= data.size();)
+            {
+                const uint32_t word = load32(data.data() + i);
+                auto & slot = table_[(word * 2654435761u) >> (32 - HashBits)];
+                const uint64_t candidate = slot;
+                slot = static_cast<uint32_t>(i + 1);
+                if (candidate == 0 || load32(data.data() + candidate - 1) != word) {
+                    i++;
+                    continue;
+                }
+
+                uint64_t length = MinMatch;
+                while (i + length < data.size() && data[candidate - 1 + length] == data[i + length]) length++;
+                ret.covered += length;
+                ret.matches++;
+                i += length;
+            }
+
+            return ret;
+        }
+    };
+
+    /// Binary block map: one map_header_t followed by one map_record_t per block, little endian
+    struct map_header_t
+    {
+        char magic[4] = { 'E', 'M', 'A', 'P' };
+        uint32_t version = 1;
+        uint64_t block_size = 0;
+        uint64_t file_size = 0;
+    };
+
+    struct map_record_t
+    {
+        float order0;
+        float order1;
+        float lzw_ratio;
+        float huffman_ratio;
+        uint8_t suggestion;
+        uint8_t reserved[3];
+    };
+
+    /// Per-block estimator. Construct one per thread and reuse it, the scratch tables are large.
+    /// @tparam LZWMaxBitSize Code width limit of the LZW codec being estimated
+    template < uint64_t LZWMaxBitSize = 12 >
+    class block_model
+    {
+        static constexpr uint64_t FirstFreeCode = 258;
+        static constexpr uint64_t MaxCode = (1ull << LZWMaxBitSize) - 1;
+        static constexpr uint64_t TableBits = std::bit_width(MaxCode) + 1;
+
+        struct slot_t
+        {
+            uint32_t key;
+            uint32_t code;
+            uint32_t epoch;
+        };
+
+        std::vector < uint32_t > pair_counts_;
+        std::vector < slot_t > table_;
+        uint32_t epoch_ = 0;
+        ::lzw::Huffman huffman_;
+        std::vector < uint8_t > huffman_header_;
+        std::vector < double > count_log_count_; ///< c * log2(c), indexed by c, grown to the largest block seen
+
+        void prepare_count_log_count(const uint64_t max_count)
+        {
+            for (uint64_t c = count_log_count_.size(); c <= max_count; c++) {
+                count_log_count_.push_back(static_cast<double>(count_log_count(c)));
+            }
+        }
+
+        void reset_table()
+        {
+            if (++epoch_ == 0)
+            {
+                std::ranges::fill(table_, slot_t { });
+                epoch_ = 1;
+            }
+        }
+
+    public:
+        block_model() : pair_counts_(65536, 0), table_(1ull << TableBits, slot_t { }) { }
+
+        /// Order-1 entropy, H(X | previous byte)
+        /// @return Bits per byte, 0 for blocks shorter than two bytes
+        [[nodiscard]] long double order1(const std::span<const uint8_t> data)
+        {
+            if (data.size() < 2) return 0;
+
+            histogram_t contexts { };
+            cpu::kernels().histogram(data.first(data.size() - 1), contexts);
+            for (uint64_t i = 1; i < data.size(); i++) {
+                pair_counts_[(data[i - 1] << 8) | data[i]]++;
+            }
+
+            // H(X|P) = (sum c(p) log c(p) - sum c(p,x) log c(p,x)) / N, counters are cleared on the way out
+            prepare_count_log_count(data.size());
+            long double sum = 0;
+            for (const auto count : contexts) {
+                sum += count_log_count_[count];
+            }
+
+            for (uint64_t i = 1; i < data.size(); i++)
+            {
+                auto & count = pair_counts_[(data[i - 1] << 8) | data[i]];
+                sum -= count_log_count_[count];
+                count = 0;
+            }
+
+            return sum / static_cast<long double>(data.size() - 1);
+        }
+
+        /// Approximate size of an LZW stream for data, from a plain parse starting at 9 bits and 258 codes
+        /// without emitting anything. It does not follow the EOI width rule of lzw<LZWMaxBitSize> and knows
+        /// nothing of alphabet-rank blocks, the stored path or LZ77, so it is an estimate, not what block_codec writes.
+        /// @return Bits, ClearCode and EOI included
+        [[nodiscard]] uint64_t lzw_bits(const std::span<const uint8_t> data)
+        {
+            reset_table();
+            uint64_t width = 9, next_code = FirstFreeCode;
+            uint64_t bits = width; // ClearCode
+            uint32_t w = UINT32_MAX;
+            for (const auto k : data)
+            {
+                if (w == UINT32_MAX) {
+                    w = k;
+                    continue;
+                }
+
+                const uint32_t key = (w << 8) | k;
+                uint64_t slot = (key * 0x9E3779B1u) >> (32 - TableBits);
+                while (table_[slot].epoch == epoch_ && table_[slot].key != key) {
+                    slot = (slot + 1) & ((1ull << TableBits) - 1);
+                }
+
+                if (table_[slot].epoch == epoch_) {
+                    w = table_[slot].code;
+                    continue;
+                }
+
+                bits += width;
+                if (next_code <= MaxCode)
+                {
+                    table_[slot] = { .key = key, .code = static_cast<uint32_t>(next_code), .epoch = epoch_ };
+                    if (++next_code > (1ull << width) && width < LZWMaxBitSize) {
+                        ++width;
+                    }
+                }
+                else
+                {
+                    bits += width;
+                    reset_table();
+                    width = 9;
+                    next_code = FirstFreeCode;
+                }
+
+                w = k;
+            }
+
+            if (w != UINT32_MAX) bits += width;
+            return bits + width; // EOI
+        }
+
+        /// Estimate every metric for one block
+        /// @param data Block
+        /// @param total If not null, the block histogram is added to it
+        [[nodiscard]] block_estimate_t analyze(const std::span<const uint8_t> data, histogram_t * total = nullptr)
+        {
+            block_estimate_t ret;
+            if (data.empty()) return ret;
+
+            histogram_t histogram { };
+            cpu::kernels().histogram(data, histogram);
+            if (total) {
+                for (int sym = 0; sym < 256; sym++) (*total)[sym] += histogram[sym];
+            }
+
+            const auto size = static_cast<double>(data.size());
+
+            ret.order0 = static_cast<double>(entropy_of(histogram));
+            ret.order1 = static_cast<double>(order1(data));
+            ret.lzw_ratio = static_cast<double>((lzw_bits(data) + 7) / 8) / size;
+
+            // The code table is built for real, only the encode pass is skipped
+            huffman_header_.clear();
+            huffman_.build_table(data);
+            uint64_t huffman_bytes = 0;
+            if (huffman_.write_table(data.size(), huffman_header_)) {
+                huffman_bytes = sizeof(uint64_t) + (huffman_.encoded_bits() + 7) / 8;
+            }
+            huffman_bytes += huffman_header_.size();
+            ret.huffman_ratio = static_cast<double>(huffman_bytes) / size;
+
+            if (std::min(ret.lzw_ratio, ret.huffman_ratio) >= 1.0) {
+                ret.suggestion = Store;
+            } else {
+                ret.suggestion = ret.huffman_ratio > ret.lzw_ratio ? LZW : Huffman; // ties go to Huffman
+            }
+
+            return ret;
+        }
+    };
+}
+
+#endif //LZW_ENTROPY_H
@@ -0,0 +1,67 @@
+#ifndef LZW_HISTOGRAM_H
+#define LZW_HISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+namespace lzw
+{
+    using histogram_t = std::array < uint64_t, 256 >;
+
+    /// Count every byte of data into histogram, shared by Huffman table builds, codec selection and the entropy tool.
+    /// Bytes are loaded a 64-bit word at a time and spread over four 32-bit sub-histograms, so runs of the same
+    /// byte do not serialize on a single counter (store-to-load forwarding). The tables are folded in with a plain
+    /// loop the compiler vectorizes. A vector gather/scatter kernel loses to this one: lanes hitting the same
+    /// counter conflict, which is exactly the case the sub-histograms are there for
+    /// @param data Input bytes
+    /// @param histogram Accumulated counts
+    inline void accumulate_histogram(const std::span<const uint8_t> data, histogram_t & histogram)
+    {
+        constexpr uint64_t Tables = 4;
+        constexpr uint64_t MaxChunk = 1ull << 32;   // a quarter of it per table still fits 32 bits
+        constexpr uint64_t SmallInput = 256;        // clearing and folding the tables costs more than it saves
+
+        if (data.size() < SmallInput)
+        {
+            for (const auto c : data) histogram[c]++;
+            return;
+        }
+
+        alignas(64) uint32_t counts[Tables][256];
+        for (uint64_t offset = 0; offset < data.size(); offset += MaxChunk)
+        {
+            const auto chunk = data.subspan(offset, std::min(MaxChunk, data.size() - offset));
+            const uint8_t * bytes = chunk.data();
+            const uint64_t size = chunk.size();
+            std::memset(counts, 0, sizeof(counts));
+
+            uint64_t i = 0;
+            for (; i + 16 <= size; i += 16)
+            {
+                uint64_t low = 0, high = 0;
+                std::memcpy(&low, bytes + i, sizeof(low));
+                std::memcpy(&high, bytes + i + sizeof(low), sizeof(high));
+                for (uint64_t k = 0; k < 8; k++) {
+                    counts[k % Tables][(low >> (8 * k)) & 0xFF]++;
+                }
+
+                for (uint64_t k = 0; k < 8; k++) {
+                    counts[k % Tables][(high >> (8 * k)) & 0xFF]++;
+                }
+            }
+
+            for (; i < size; i++) {
+                counts[0][bytes[i]]++;
+            }
+
+            for (uint64_t sym = 0; sym < 256; sym++) {
+                histogram[sym] += static_cast<uint64_t>(counts[0][sym]) + counts[1][sym] + counts[2][sym] + counts[3][sym];
+            }
+        }
+    }
+}
+
+#endif //LZW_HISTOGRAM_H
@@ -0,0 +1,146 @@
+#ifndef LZW_LZ77_H
+#define LZW_LZ77_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "lzw6.h"
+
+namespace lzw
+{
+    /// How hard the LZ77 match finder searches
+    enum class lz77_mode_t
+    {
+        Off,        ///< Blocks are not tried with LZ77
+        Fast,       ///< Only the latest position of each hash, enough for runs and recent repeats
+        Greedy,     ///< Take the longest match of a short hash chain as soon as it is found
+        Lazy,       ///< Search longer chains, and emit a literal first if the next position matches longer
+    };
+
+    /// LZ77 block codec with a hash-chain match finder. Matches reach back up to a window of bytes, into the
+    /// blocks before the current one while the caller continues the history, so long repeats across blocks
+    /// cost a few bytes each where LZW would have to rebuild its dictionary first.
+    /// Literals and sequence tokens go through Huffman when that is smaller, match distances are written
+    /// with as many bits as the farthest reachable byte needs:
+    /// [UINT8: WINDOW LOG][UINT8: FLAGS][UINT16: LITERALS SIZE][LITERALS][UINT16: TOKENS SIZE][TOKENS][EXTRA BITS]
+    /// A token is [LITERAL RUN << 4 | MATCH LENGTH - MinMatch], 15 in either half continues as an Elias gamma
+    /// code in the extra bits. The last token carries the literals after the last match only
+    class lz77
+    {
+    public:
+        static constexpr uint64_t MinMatch = 4;
+        static constexpr uint64_t MinWindowLog = 10;
+        static constexpr uint64_t MaxWindowLog = 22;
+        static constexpr uint64_t DefaultWindowLog = 16;
+        /// Largest block, stream sizes are 16-bit
+        static constexpr uint64_t MaxBlockSize = 0xFFFF;
+
+        lz77() = default;
+        lz77(const lz77 &) = delete;
+        lz77 & operator=(const lz77 &) = delete;
+
+        /// Choose the match finder and the window of the following blocks, the history starts over
+        /// @param mode Fast, Greedy or Lazy, Off is kept as Greedy
+        /// @param window_log Window is 2^window_log bytes
+        /// @throws std::invalid_argument window_log is out of [MinWindowLog, MaxWindowLog]
+        void set_mode(lz77_mode_t mode, uint64_t window_log);
+
+        /// Compress src into dst, dst is overwritten. src joins the history afterwards
+        /// @param src Block, at most MaxBlockSize bytes
+        /// @param dst Output buffer, its capacity is reused
+        /// @param continue_history Let matches reach into the blocks before, otherwise the history starts with src
+        /// @throws std::invalid_argument src is larger than MaxBlockSize
+        void compress(std::span<const uint8_t> src, std::vector<uint8_t> & dst, bool continue_history = false);
+
+        /// Add a block kept by another codec to the history of compress() without compressing it
+        /// @param src Block, at most MaxBlockSize bytes
+        /// @param continue_history Append to the history, otherwise the history starts with src
+        /// @throws std::invalid_argument src is larger than MaxBlockSize
+        void skip(std::span<const uint8_t> src, bool continue_history);
+
+        /// Make the last block compressed or skipped the first one of the history, when the block kept
+        /// for it does not continue the blocks before
+        void restart_history_at_last_block() noexcept { history_begin_ = block_begin_; }
+
+        /// Decompress src into dst, dst is overwritten. The block joins the history afterwards
+        /// @param src Compressed block
+        /// @param dst Output buffer, its capacity is reused
+        /// @param continue_history Matches may reach into the blocks before
+        /// @throws std::runtime_error, std::invalid_argument, std::out_of_range Corrupted block,
+        ///         or a continued block without a history
+        void decompress(std::span<const uint8_t> src, std::vector<uint8_t> & dst, bool continue_history = false);
+
+        /// Add a block decoded by another codec to the history of decompress()
+        /// @param block Decoded block
+        /// @param continue_history Append to the history, otherwise the history starts with block
+        void append_history(std::span<const uint8_t> block, bool continue_history);
+
+        /// Forget both histories, allocations are kept
+        void reset() noexcept;
+
+    private:
+        static constexpr uint64_t HashBits = 15;
+        static constexpr uint32_t NoPosition = 0;
+        static constexpr uint64_t LiteralsCoded = 1;
+        static constexpr uint64_t TokensCoded = 2;
+
+        struct match_t
+        {
+            uint64_t length;
+            uint64_t distance;
+        };
+
+        lz77_mode_t mode_ = lz77_mode_t::Greedy;
+        uint64_t window_log_ = DefaultWindowLog;
+        uint64_t max_chain_ = 16;
+        uint64_t nice_length_ = 64;
+
+        // Encoder. Positions are counted from 1 over every block compressed, NoPosition ends a chain.
+        // buffer_ holds the window before the current block and the block itself
+        std::vector<uint8_t> buffer_;
+        uint32_t buffer_begin_ = 1;         ///< Position of buffer_[0]
+        uint32_t history_begin_ = 1;        ///< First position matches may reach
+        uint32_t block_begin_ = 1;          ///< Position of the last block compressed
+        uint32_t next_insert_ = 1;          ///< First position not in the hash chains yet
+        std::vector<uint32_t> head_;        ///< Latest position of each hash
+        std::vector<uint32_t> prev_;        ///< Position before it with the same hash, by position modulo window
+
+        // Decoder, window_ ends with the last block decompressed
+        std::vector<uint8_t> window_;
+        uint64_t history_bytes_ = 0;        ///< Bytes since the history started, window_ keeps the last ones
+        uint64_t history_window_log_ = MaxWindowLog; ///< Window of the last LZ77 block, window_ keeps 2^this bytes
+        bool has_history_ = false;
+
+        std::vector<uint8_t> literals_;
+        std::vector<uint8_t> tokens_;
+        std::vector<uint8_t> extra_;
+        std::vector<uint8_t> coded_;
+        Huffman huffman_;
+
+        /// Farthest distance a match at offset of a block may have, 0 if there is nothing behind it
+        [[nodiscard]] uint64_t max_distance(uint64_t history, uint64_t offset) const noexcept;
+
+        /// Append src to buffer_ as the next block, after dropping what the history no longer needs
+        /// @return Index of the block in buffer_
+        uint64_t begin_block(std::span<const uint8_t> src, bool continue_history);
+
+        /// Hash the position at index of buffer_ into the chains
+        void insert(uint64_t index);
+
+        /// Longest match for the position at index of buffer_, at most max_length bytes, then insert the position
+        match_t find_and_insert(uint64_t index, uint64_t max_length, uint64_t max_distance);
+
+        /// Drop the window before the history, shift positions down before they overflow
+        void slide(uint64_t incoming);
+
+        /// Append stream to dst as [UINT16: SIZE][DATA], through Huffman if that is smaller
+        /// @return Whether it went through Huffman
+        bool append_stream(const std::vector<uint8_t> & stream, std::vector<uint8_t> & dst);
+
+        /// Read a stream written by append_stream() into out
+        /// @return Bytes consumed from src
+        uint64_t read_stream(std::span<const uint8_t> src, bool coded, std::vector<uint8_t> & out);
+    };
+}
+
+#endif //LZW_LZ77_H
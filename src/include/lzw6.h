@@ -10,7 +10,10 @@
 #include <vector>
 #include <functional>
 #include <ranges>
-#include <list>
+#include <array>
+#include <bit>
+#include <span>
+#include "cpu_features.h"
 #ifdef USE_TSL_HOPSCOTCH_MAP
 # include "tsl/hopscotch_map.h"
 # define lzw_dictionary_t tsl::hopscotch_map
@@ -29,38 +32,150 @@ namespace lzw
 
         explicit BitWriterLSB(std::vector<uint8_t>& o) : out(o) { }
 
-        void write(const uint64_t code, const uint64_t width) {
-            for (uint64_t i = 0; i < width; ++i, ++bitpos) {
-                const uint64_t bytepos = bitpos >> 3;
-                const uint64_t bitoff  = bitpos & 7;
-                if (bytepos >= out.size()) out.push_back(0);
-                const uint8_t bit = (code >> i) & 1;
-                out[bytepos] |= (bit << bitoff);
+        /// Append the low width bits of code, a byte at a time
+        void write(const uint64_t code, const uint64_t width)
+        {
+            if (width == 0) return;
+            const uint64_t end = (bitpos + width + 7) >> 3;
+            if (end > out.size()) out.resize(end, 0);
+
+            const uint64_t value = width < 64 ? code & ((1ULL << width) - 1) : code;
+            const uint64_t bitoff = bitpos & 7;
+            uint8_t * byte = out.data() + (bitpos >> 3);
+            *byte |= static_cast<uint8_t>(value << bitoff);
+            for (uint64_t written = 8 - bitoff; written < width; written += 8) {
+                *++byte |= static_cast<uint8_t>(value >> written);
             }
+
+            bitpos += width;
         }
+
+        /// write() with a width known at compile time
+        template < uint64_t Width >
+        void write(const uint64_t code) { write(code, Width); }
     };
 
     struct BitReaderLSB
     {
-        const std::vector<uint8_t>& in;
+        std::span<const uint8_t> in;
         uint64_t bitpos = 0;
 
-        explicit BitReaderLSB(const std::vector<uint8_t>& i) : in(i) {}
+        explicit BitReaderLSB(const std::span<const uint8_t> i) : in(i) {}
 
         uint64_t read(const uint64_t width)
         {
             const uint64_t total_bits = in.size() * 8;
             if (bitpos + width > total_bits) throw std::out_of_range("EOF");
+            if (width == 0) return 0;
+
+            const uint64_t mask = width < 64 ? (1ULL << width) - 1 : UINT64_MAX;
+            const uint64_t bytepos = bitpos >> 3;
+            const uint64_t bitoff = bitpos & 7;
+            bitpos += width;
+
+            // one unaligned load while a whole word is left, which covers every width up to 56
+            if (std::endian::native == std::endian::little && width <= 56 && in.size() - bytepos >= sizeof(uint64_t))
+            {
+                uint64_t word = 0;
+                std::memcpy(&word, in.data() + bytepos, sizeof(word));
+                return (word >> bitoff) & mask;
+            }
+
+            const uint8_t * byte = in.data() + bytepos;
+            uint64_t v = *byte >> bitoff;
+            for (uint64_t got = 8 - bitoff; got < width; got += 8) {
+                v |= static_cast<uint64_t>(*++byte) << got;
+            }
+
+            return v & mask;
+        }
+
+        /// read() with a width known at compile time
+        template < uint64_t Width >
+        uint64_t read() { return read(Width); }
+    };
+
+    /// Bit IO stream packing codes from the most significant bit of each byte down, as TIFF and PDF do
+    struct BitWriterMSB
+    {
+        std::vector<uint8_t>& out;
+        uint64_t bitpos = 0;
+
+        explicit BitWriterMSB(std::vector<uint8_t>& o) : out(o) { }
+
+        /// Append the low width bits of code, highest bit first
+        void write(const uint64_t code, const uint64_t width)
+        {
+            if (width == 0) return;
+            const uint64_t end = (bitpos + width + 7) >> 3;
+            if (end > out.size()) out.resize(end, 0);
+
+            const uint64_t value = width < 64 ? code & ((1ULL << width) - 1) : code;
+            const uint64_t room = 8 - (bitpos & 7);
+            uint8_t * byte = out.data() + (bitpos >> 3);
+            bitpos += width;
+            if (width <= room) {
+                *byte |= static_cast<uint8_t>(value << (room - width));
+                return;
+            }
 
-            uint64_t v = 0;
-            for (uint64_t i = 0; i < width; ++i, ++bitpos) {
-                const uint64_t bytepos = bitpos >> 3;
-                const uint64_t bitoff  = bitpos & 7;
-                const uint8_t bit = (in[bytepos] >> bitoff) & 1;
-                v |= (static_cast<uint64_t>(bit) << i);
+            uint64_t left = width - room;
+            *byte |= static_cast<uint8_t>(value >> left);
+            for (; left >= 8; left -= 8) {
+                *++byte |= static_cast<uint8_t>(value >> (left - 8));
             }
-            return v;
+
+            if (left) *++byte |= static_cast<uint8_t>(value << (8 - left));
         }
+
+        /// write() with a width known at compile time
+        template < uint64_t Width >
+        void write(const uint64_t code) { write(code, Width); }
+    };
+
+    struct BitReaderMSB
+    {
+        std::span<const uint8_t> in;
+        uint64_t bitpos = 0;
+
+        explicit BitReaderMSB(const std::span<const uint8_t> i) : in(i) {}
+
+        uint64_t read(const uint64_t width)
+        {
+            const uint64_t total_bits = in.size() * 8;
+            if (bitpos + width > total_bits) throw std::out_of_range("EOF");
+            if (width == 0) return 0;
+            if (width > 56) {
+                const uint64_t high = read(width - 32);
+                return (high << 32) | read(32);
+            }
+
+            const uint64_t bytepos = bitpos >> 3;
+            const uint64_t bitoff = bitpos & 7;
+            bitpos += width;
+
+            // one unaligned load while a whole word is left
+            if (in.size() - bytepos >= sizeof(uint64_t))
+            {
+                uint64_t word = 0;
+                std::memcpy(&word, in.data() + bytepos, sizeof(word));
+                if constexpr (std::endian::native == std::endian::little) word = std::byteswap(word);
+                return (word << bitoff) >> (64 - width);
+            }
+
+            const uint8_t * byte = in.data() + bytepos;
+            uint64_t v = *byte & (0xFF >> bitoff);
+            uint64_t got = 8 - bitoff;
+            for (; got < width; got += 8) {
+                v = (v << 8) | *++byte;
+            }
+
+            return v >> (got - width);
+        }
+
+        /// read() with a width known at compile time
+        template < uint64_t Width >
+        uint64_t read() { return read(Width); }
     };
 
     template <typename Type>
@@ -70,6 +185,30 @@ namespace lzw
         return static_cast<Type>(0x01) << n;
     }
 
+    /// What the encoder does once its dictionary is full. The decoder only follows the ClearCodes it reads,
+    /// so the policy is free to change per stream
+    enum class reset_policy_t
+    {
+        Immediate,  ///< ClearCode at once, the classic behaviour
+        Monitor,    ///< Keep the full dictionary while the compression ratio holds, ClearCode once it drops
+        Freeze,     ///< Keep the full dictionary to the end of the stream
+    };
+
+    /// How the dictionary grows after each emitted code. Both ends of a stream must use the same strategy
+    enum class growth_t
+    {
+        Classic,    ///< Previous match extended by the first symbol of the current one
+        LZMW,       ///< Previous match followed by the whole current match
+        LZAP,       ///< Previous match followed by every non-empty prefix of the current match
+    };
+
+    /// Order codes are packed into bytes
+    enum class bit_order_t
+    {
+        LSB,        ///< Lowest bit first, GIF and the lzw container
+        MSB,        ///< Highest bit first, TIFF and PDF
+    };
+
     template <
         uint64_t LZWMaxBitSize,
         const bool EarlyChange = false,
@@ -78,159 +217,752 @@ namespace lzw
         const uint64_t ClearCode = 1 << MinimumCodeSize,
         const uint64_t EOICode = ClearCode + 1,
         const uint64_t FirstFreeCode = ClearCode + 2,
-        const uint64_t MaxCode  = (1 << LZWMaxBitSize) - 1
+        const uint64_t MaxCode  = (1 << LZWMaxBitSize) - 1,
+        const growth_t Growth = growth_t::Classic,
+        const bit_order_t BitOrder = bit_order_t::LSB,
+        const bool RequireEOI = true    ///< false: a stream ending without EOI decodes up to its last whole code
     >
-    requires (LZWMaxBitSize <= 63)
+    requires (LZWMaxBitSize <= (Growth == growth_t::LZMW ? 22 : 24)) // codes, nodes and keys are kept in 32-bit table slots
     class lzw {
-        const std::vector<uint8_t> & input_;
-        std::vector<uint8_t> & output_;
+        using BitWriter = std::conditional_t < BitOrder == bit_order_t::MSB, BitWriterMSB, BitWriterLSB >;
+        using BitReader = std::conditional_t < BitOrder == bit_order_t::MSB, BitReaderMSB, BitReaderLSB >;
+
+        const std::vector<uint8_t> * bound_input_ = nullptr;
+        std::vector<uint8_t> * bound_output_ = nullptr;
+
+        static constexpr uint32_t NoEntry = UINT32_MAX;
+        static constexpr uint32_t PresetEpoch = UINT32_MAX; // preset slots survive every reset
+        /// LZMW entries are not prefix closed, so its encoder walks a trie of nodes of which only some are codes
+        static constexpr uint64_t NodeLimit = Growth == growth_t::LZMW ? 4 * (MaxCode + 1) : MaxCode + 1;
+        static constexpr uint64_t EncoderTableBits = std::bit_width(NodeLimit - 1) + 1; // load factor stays below 1/2
+        static constexpr uint64_t EncoderTableSize = const_two_power(EncoderTableBits);
+        /// Longest LZMW entry, longer ones are numbered but never emitted. Doubling matches cannot blow up the decoder
+        static constexpr uint64_t MaxEntryLength = 0x10000;
+
+        /// Encoder dictionary slot, (prefix code, suffix byte) -> code.
+        /// A slot is only valid if its epoch matches the current one, so a dictionary reset is a single increment
+        struct encoder_slot_t
+        {
+            uint32_t key;
+            uint32_t code;
+            uint32_t epoch;
+        };
 
-    public:
-        lzw(const std::vector<uint8_t> & input, std::vector<uint8_t> & output)
-            : input_(input), output_(output) { }
+        std::vector < encoder_slot_t > encoder_table_;
+        uint32_t encoder_epoch_ = 0;
+        std::vector < uint32_t > node_code_;    ///< LZMW: code of each trie node, NoEntry for inner nodes only
+        uint64_t next_node_ = 0;                ///< LZMW: first unused trie node
+        uint64_t dictionary_resets_ = 0;
+
+        /// Ratio monitor of a full dictionary: output bits per input byte (16.16 fixed point)
+        /// over windows of MonitorWindow input bytes, compared to the best window since the dictionary filled.
+        /// Positions count from the start of the stream, so windows span continued compress() calls
+        static constexpr uint64_t MonitorWindow = 4096;
+        reset_policy_t reset_policy_ = reset_policy_t::Immediate;
+        uint64_t monitor_input_ = 0;        ///< Input bytes of the stream before this compress()
+        uint64_t monitor_bits_ = 0;         ///< Bits written by the stream before this compress()
+        uint64_t monitor_window_input_ = UINT64_MAX;
+        uint64_t monitor_window_bits_ = 0;
+        uint64_t monitor_best_ = UINT64_MAX;
+
+        /// Preset entries, (prefix << 8) | suffix in code order from FirstFreeCode. Every reset returns to them
+        std::vector < uint32_t > preset_keys_;
+        uint64_t base_next_code_ = FirstFreeCode;
+
+        /// Dictionary position left by the last complete compress()/decompress(), 0 if there is none to continue
+        uint64_t encoder_next_code_ = 0;
+        uint64_t encoder_code_width_ = 0;
+        uint64_t decoder_next_code_ = 0;
+
+        /// Decoder dictionary, stored as prefix chains. Codes >= next_code are simply stale, so no reset is needed
+        std::vector < uint32_t > decoder_prefix_;
+        std::vector < uint32_t > decoder_length_;
+        std::vector < uint8_t > decoder_suffix_;
+        std::vector < uint8_t > decoder_first_;
+        std::vector < uint32_t > decoder_tail_;     ///< LZMW: entries are pairs (decoder_prefix_, decoder_tail_) of codes
+        std::vector < uint32_t > decoder_stack_;    ///< LZMW: heads waiting while a pair is written backwards
+
+        /// Allocate encoder table and insert the preset on first use, otherwise invalidate every other slot
+        void reset_encoder_table()
+        {
+            if (encoder_table_.empty())
+            {
+                encoder_table_.resize(EncoderTableSize, encoder_slot_t { .key = 0, .code = 0, .epoch = 0 });
+                encoder_epoch_ = 0;
+                for (uint64_t i = 0; i < preset_keys_.size(); i++)
+                {
+                    uint64_t slot = (preset_keys_[i] * 0x9E3779B1u) >> (32 - EncoderTableBits);
+                    while (encoder_table_[slot].epoch == PresetEpoch) slot = (slot + 1) & (EncoderTableSize - 1);
+                    encoder_table_[slot] = { .key = preset_keys_[i], .code = static_cast<uint32_t>(FirstFreeCode + i), .epoch = PresetEpoch };
+                }
+            }
 
-        void compress()
+            if (++encoder_epoch_ == PresetEpoch) // wrapped around, stale slots would look valid again
+            {
+                for (auto & slot : encoder_table_) {
+                    if (slot.epoch != PresetEpoch) slot = encoder_slot_t { .key = 0, .code = 0, .epoch = 0 };
+                }
+
+                encoder_epoch_ = 1;
+            }
+
+            if constexpr (Growth == growth_t::LZMW)
+            {
+                // single symbols and preset entries are nodes numbered like their codes
+                if (node_code_.empty()) {
+                    node_code_.resize(NodeLimit, NoEntry);
+                    for (uint32_t node = 0; node < base_next_code_; node++) node_code_[node] = node;
+                }
+
+                next_node_ = base_next_code_;
+            }
+        }
+
+        /// Find (prefix, suffix) in the encoder table
+        /// @param key (prefix << 8) | suffix
+        /// @param slot Set to the matching slot, or the free slot where key should be inserted
+        /// @return Code if found, NoEntry otherwise
+        uint32_t find_encoder_entry(const uint32_t key, uint64_t & slot) const
         {
-            output_.clear();
-            BitWriterLSB BitStream(output_);
-            lzw_dictionary_t < std::string, uint64_t > dictionary;
-            dictionary.reserve(MaxDictionarySize);
-            auto init_dict = [&dictionary]
+            slot = (key * 0x9E3779B1u) >> (32 - EncoderTableBits);
+            while (encoder_table_[slot].epoch == encoder_epoch_ || encoder_table_[slot].epoch == PresetEpoch)
             {
-                for (uint64_t i = 0; i < ClearCode; ++i) {
-                    dictionary[{static_cast<char>(i)}] = i;
+                if (encoder_table_[slot].key == key) {
+                    return encoder_table_[slot].code;
                 }
-            };
 
-            init_dict();
+                slot = (slot + 1) & (EncoderTableSize - 1);
+            }
 
-            uint64_t code_width = MinimumCodeSize + 1;
-            uint64_t next_code = FirstFreeCode;
-            BitStream.write(ClearCode, code_width);
+            return NoEntry;
+        }
+
+        /// Allocate decoder tables on first use and seed single symbol entries, which never change
+        void prepare_decoder_table()
+        {
+            if (!decoder_prefix_.empty()) return;
+            decoder_prefix_.resize(MaxCode + 1, 0);
+            decoder_length_.resize(MaxCode + 1, 0);
+            decoder_suffix_.resize(MaxCode + 1, 0);
+            decoder_first_.resize(MaxCode + 1, 0);
+            if constexpr (Growth == growth_t::LZMW) decoder_tail_.resize(MaxCode + 1, 0);
+            for (uint64_t i = 0; i < ClearCode; ++i) {
+                decoder_suffix_[i] = static_cast<uint8_t>(i);
+                decoder_first_[i] = static_cast<uint8_t>(i);
+                decoder_length_[i] = 1;
+            }
+        }
 
-            std::string w;
-            for (const auto k : input_)
+        /// Append the string of a code to output by walking its prefix chain backwards
+        void emit_decoder_entry(uint64_t code, std::vector<uint8_t> & output)
+        {
+            const uint64_t length = decoder_length_[code];
+            const uint64_t offset = output.size();
+            output.resize(offset + length);
+            uint8_t * out = output.data() + offset;
+            for (uint64_t i = length; i > 0; --i) {
+                out[i - 1] = decoder_suffix_[code];
+                code = decoder_prefix_[code];
+            }
+        }
+
+        /// Append the string of an LZMW pair code to output, tails are written first from the end backwards
+        /// @throws std::invalid_argument Code is longer than any entry the encoder emits
+        void emit_decoder_pair(uint64_t code, std::vector<uint8_t> & output)
+        {
+            const uint64_t length = decoder_length_[code];
+            if (length > MaxEntryLength) {
+                throw std::invalid_argument("Corrupted LZW stream (entry too long)");
+            }
+
+            const uint64_t offset = output.size();
+            output.resize(offset + length);
+            uint8_t * out = output.data() + offset + length;
+            decoder_stack_.clear();
+            while (true)
             {
-                std::string wk = w;
-                wk.push_back(*reinterpret_cast<const char *>(&k));
+                while (code >= ClearCode) {
+                    decoder_stack_.push_back(decoder_prefix_[code]);
+                    code = decoder_tail_[code];
+                }
 
-                if (dictionary.contains(wk)) {
-                    w = wk;
-                    continue;
+                *--out = static_cast<uint8_t>(code);
+                if (decoder_stack_.empty()) break;
+                code = decoder_stack_.back();
+                decoder_stack_.pop_back();
+            }
+        }
+
+        /// Longest entry at the start of src, for LZMW and LZAP
+        /// @param src Remaining input, not empty
+        /// @param length Set to the length of the match
+        /// @return Code of the match
+        uint32_t longest_match(const std::span<const uint8_t> src, uint64_t & length) const
+        {
+            uint32_t node = src[0];
+            uint32_t code = node;
+            length = 1;
+            for (uint64_t i = 1; i < src.size(); i++)
+            {
+                uint64_t slot = 0;
+                node = find_encoder_entry((node << 8) | src[i], slot);
+                if (node == NoEntry) break;
+
+                if constexpr (Growth == growth_t::LZMW) {
+                    if (node_code_[node] == NoEntry) continue; // inner node, a longer entry may still follow
                 }
 
-                // Output current longest string
-                BitStream.write(dictionary[w], code_width);
+                code = Growth == growth_t::LZMW ? node_code_[node] : node;
+                length = i + 1;
+            }
 
-                // Add new entry
-                if (next_code <= MaxCode) {
-                    dictionary[wk] = next_code;
-                    ++next_code;
+            return code;
+        }
 
-                    // Code width increase: encoder and decoder must follow same rule
-                    const uint64_t threshold = (1ULL << code_width) - (EarlyChange ? 1 : 0);
-                    if (next_code > threshold && code_width < LZWMaxBitSize) {
-                        ++code_width;
+        /// Add the entries of the match just emitted following the one before it, for LZMW and LZAP
+        /// @param prev Code of the previous match
+        /// @param joined Previous match followed by the current one
+        /// @param current_length Length of the current match
+        /// @param next_code Next free code, advanced past the new entries
+        void add_encoder_entries(uint32_t prev, const std::span<const uint8_t> joined, const uint64_t current_length,
+            uint64_t & next_code)
+        {
+            uint64_t slot = 0;
+            if constexpr (Growth == growth_t::LZAP)
+            {
+                // every prefix: prev + one symbol, the entry just added + one symbol, ...
+                // An entry already present takes a code the encoder never emits, the decoder cannot tell
+                for (const auto k : joined.last(current_length))
+                {
+                    if (next_code > MaxCode) break;
+                    const uint32_t key = (prev << 8) | k;
+                    if (const auto code = find_encoder_entry(key, slot); code != NoEntry) {
+                        prev = code;
+                    } else {
+                        encoder_table_[slot] = { .key = key, .code = static_cast<uint32_t>(next_code), .epoch = encoder_epoch_ };
+                        prev = static_cast<uint32_t>(next_code);
                     }
-                } else {
-                    // Dictionary full: write Clear and reset
+
+                    ++next_code;
+                }
+            }
+            else
+            {
+                // The whole pair as one entry, inner trie nodes are created on the way.
+                // Entries that are too long or find no free node are only numbered
+                uint32_t node = joined[0];
+                bool indexed = joined.size() <= MaxEntryLength;
+                for (uint64_t i = 1; indexed && i < joined.size(); i++)
+                {
+                    const uint32_t key = (node << 8) | joined[i];
+                    node = find_encoder_entry(key, slot);
+                    if (node == NoEntry)
+                    {
+                        if (next_node_ == NodeLimit) {
+                            indexed = false;
+                            break;
+                        }
+
+                        node = static_cast<uint32_t>(next_node_++);
+                        node_code_[node] = NoEntry;
+                        encoder_table_[slot] = { .key = key, .code = node, .epoch = encoder_epoch_ };
+                    }
+                }
+
+                if (indexed && node_code_[node] == NoEntry) {
+                    node_code_[node] = static_cast<uint32_t>(next_code);
+                }
+
+                ++next_code;
+            }
+        }
+
+        /// LZMW and LZAP parse. Unlike classic LZW, both ends add the entries of a code right after it,
+        /// so a code never refers to an entry the decoder has yet to build
+        void compress_grown(const std::span<const uint8_t> src, BitWriter & BitStream, uint64_t & next_code, uint64_t & code_width)
+        {
+            uint32_t prev = NoEntry;
+            uint64_t prev_start = 0;
+            for (uint64_t position = 0; position < src.size();)
+            {
+                if constexpr (ClearCode < 256) {
+                    if (src[position] >= ClearCode) throw std::invalid_argument("Symbol exceeds LZW alphabet");
+                }
+
+                uint64_t length = 0;
+                uint32_t code = longest_match(src.subspan(position), length);
+                BitStream.write(code, code_width);
+
+                if (prev == NoEntry) {
+                    // first match of a dictionary, nothing to pair it with
+                } else if (next_code <= MaxCode) {
+                    add_encoder_entries(prev, src.subspan(prev_start, position + length - prev_start), length, next_code);
+                } else if (reset_policy_ == reset_policy_t::Immediate || (reset_policy_ == reset_policy_t::Monitor
+                    && ratio_dropped(monitor_input_ + position, monitor_bits_ + BitStream.bitpos)))
+                {
                     BitStream.write(ClearCode, code_width);
+                    reset_encoder_table();
+                    ++dictionary_resets_;
+
+                    next_code = base_next_code_;
+                    code_width = encoder_width(next_code);
+                    monitor_window_input_ = UINT64_MAX;
+                    monitor_best_ = UINT64_MAX;
+                    code = NoEntry;
+                }
 
-                    dictionary.clear();
-                    init_dict();
+                while (next_code > (1ULL << code_width) - (EarlyChange ? 1 : 0) && code_width < LZWMaxBitSize) {
+                    ++code_width;
+                }
 
-                    code_width = MinimumCodeSize + 1;
-                    next_code = FirstFreeCode;
+                prev = code;
+                prev_start = position;
+                position += length;
+            }
+        }
+
+        /// LZMW and LZAP counterpart of compress_grown(), returns at EOI
+        void decompress_grown(BitReader & BitStream, std::vector<uint8_t> & dst, uint64_t & next_code, uint64_t & code_width)
+        {
+            int64_t prev = -1;
+            while (true)
+            {
+                if constexpr (!RequireEOI) {
+                    if (BitStream.in.size() * 8 - BitStream.bitpos < code_width) return;
+                }
+
+                const uint64_t code = BitStream.read(code_width);
+                if (code == EOICode) {
+                    return;
+                }
+
+                if (code == ClearCode) {
+                    next_code = base_next_code_;
+                    code_width = encoder_width(next_code);
+                    prev = -1;
+                    continue;
                 }
 
-                w = {*reinterpret_cast<const char *>(&k)};
+                if (code >= next_code || (code >= ClearCode && code < FirstFreeCode)) {
+                    throw std::invalid_argument("Corrupted LZW stream (invalid code)");
+                }
+
+                const uint64_t offset = dst.size();
+                if constexpr (Growth == growth_t::LZMW) {
+                    emit_decoder_pair(code, dst);
+                } else {
+                    emit_decoder_entry(code, dst);
+                }
+
+                if (prev != -1 && next_code <= MaxCode)
+                {
+                    if constexpr (Growth == growth_t::LZMW)
+                    {
+                        decoder_prefix_[next_code] = static_cast<uint32_t>(prev);
+                        decoder_tail_[next_code] = static_cast<uint32_t>(code);
+                        decoder_first_[next_code] = decoder_first_[prev];
+                        decoder_length_[next_code] = static_cast<uint32_t>(std::min(MaxEntryLength + 1,
+                            static_cast<uint64_t>(decoder_length_[prev]) + decoder_length_[code]));
+                        ++next_code;
+                    }
+                    else
+                    {
+                        uint64_t prefix = prev;
+                        for (uint64_t i = offset; i < dst.size() && next_code <= MaxCode; i++)
+                        {
+                            decoder_prefix_[next_code] = static_cast<uint32_t>(prefix);
+                            decoder_suffix_[next_code] = dst[i];
+                            decoder_first_[next_code] = decoder_first_[prev];
+                            decoder_length_[next_code] = decoder_length_[prefix] + 1;
+                            prefix = next_code++;
+                        }
+                    }
+                }
+
+                while (next_code > (1ULL << code_width) - (EarlyChange ? 1 : 0) && code_width < LZWMaxBitSize) {
+                    ++code_width;
+                }
+
+                prev = static_cast<int64_t>(code);
             }
+        }
 
-            if (!w.empty()) {
-                BitStream.write(dictionary[w], code_width);
+        /// Whether a full dictionary should be dropped, called whenever a code is emitted while it is full
+        /// @param input_position Input bytes of the stream consumed so far
+        /// @param output_bits Bits of the stream written so far
+        bool ratio_dropped(const uint64_t input_position, const uint64_t output_bits)
+        {
+            if (monitor_window_input_ == UINT64_MAX) {
+                monitor_window_input_ = input_position;
+                monitor_window_bits_ = output_bits;
+                return false;
             }
 
-            BitStream.write(EOICode, code_width);
+            const uint64_t bytes = input_position - monitor_window_input_;
+            if (bytes < MonitorWindow) return false;
+
+            const uint64_t cost = ((output_bits - monitor_window_bits_) << 16) / bytes;
+            monitor_window_input_ = input_position;
+            monitor_window_bits_ = output_bits;
+            if (cost < monitor_best_) {
+                monitor_best_ = cost;
+                return false;
+            }
+
+            // some slack, so noise around a stable ratio does not throw the dictionary away. A dictionary
+            // expanding the data goes regardless, a fresh one starts with narrower codes
+            return cost > monitor_best_ + monitor_best_ / 64 || cost > (8ull << 16);
         }
 
-        void decompress()
+        /// Width the encoder writes its next code with once next_code entries exist
+        static uint64_t encoder_width(const uint64_t next_code)
         {
-            output_.clear();
-            output_.reserve(input_.size());
-            BitReaderLSB BitStream(input_);
             uint64_t code_width = MinimumCodeSize + 1;
-            uint64_t next_code = FirstFreeCode;
-            int64_t prev = -1;  // Using -1 as sentinel for "no previous"
-            lzw_dictionary_t < uint64_t, std::string > dictionary;
+            while (code_width < LZWMaxBitSize && next_code > (1ULL << code_width) - (EarlyChange ? 1 : 0)) {
+                ++code_width;
+            }
 
-            dictionary.reserve(MaxDictionarySize);
-            auto init_dict = [&dictionary]
+            return code_width;
+        }
+
+        /// Call phase.template operator()<Width>() with the runtime code width as a compile-time constant
+        template < typename Phase >
+        static void with_width(const uint64_t code_width, Phase && phase)
+        {
+            [&]<uint64_t... Offset>(std::integer_sequence<uint64_t, Offset...>) {
+                ((code_width == MinimumCodeSize + 1 + Offset && (phase.template operator()<MinimumCodeSize + 1 + Offset>(), true)) || ...);
+            }(std::make_integer_sequence<uint64_t, LZWMaxBitSize - MinimumCodeSize>());
+        }
+
+        /// Classic parse with every code Width bits wide, from position until the width changes, the dictionary
+        /// is cleared or src ends. Width bookkeeping is one constant comparison per new entry
+        /// @return Position the next phase continues at
+        template < uint64_t Width >
+        uint64_t compress_phase(const std::span<const uint8_t> src, uint64_t position, uint32_t & w, uint64_t & next_code,
+            uint64_t & code_width, BitWriter & BitStream)
+        {
+            constexpr uint64_t threshold = (1ULL << Width) - (EarlyChange ? 1 : 0);
+            for (; position < src.size(); position++)
             {
-                dictionary.clear();
-                for (uint64_t i = 0; i < ClearCode; ++i) {
-                    dictionary[i] = std::string {static_cast<char>(i)};
+                const auto k = src[position];
+                if constexpr (ClearCode < 256) {
+                    if (k >= ClearCode) throw std::invalid_argument("Symbol exceeds LZW alphabet");
                 }
-            };
 
-            init_dict();
+                if (w == NoEntry) {
+                    w = k;
+                    continue;
+                }
+
+                uint64_t slot = 0;
+                const uint32_t key = (w << 8) | k;
+                if (const auto code = find_encoder_entry(key, slot); code != NoEntry) {
+                    w = code;
+                    continue;
+                }
+
+                // Output current longest string
+                BitStream.template write<Width>(w);
+                w = k;
+
+                // Add new entry
+                if (next_code <= MaxCode)
+                {
+                    encoder_table_[slot] = { .key = key, .code = static_cast<uint32_t>(next_code), .epoch = encoder_epoch_ };
+                    ++next_code;
+
+                    // Code width increase: encoder and decoder must follow same rule
+                    if constexpr (Width < LZWMaxBitSize) {
+                        if (next_code > threshold) {
+                            code_width = Width + 1;
+                            return position + 1;
+                        }
+                    }
+                }
+                else if (reset_policy_ == reset_policy_t::Immediate || (reset_policy_ == reset_policy_t::Monitor
+                    && ratio_dropped(monitor_input_ + position, monitor_bits_ + BitStream.bitpos)))
+                {
+                    // Dictionary full: write Clear and reset
+                    BitStream.template write<Width>(ClearCode);
+
+                    reset_encoder_table();
+                    ++dictionary_resets_;
 
-            // Read first code (should be clear)
-            uint64_t code = BitStream.read(code_width);
-            if (code != ClearCode) {
-                throw std::invalid_argument("Invalid LZW format!");
+                    next_code = base_next_code_;
+                    code_width = encoder_width(next_code);
+                    monitor_window_input_ = UINT64_MAX;
+                    monitor_best_ = UINT64_MAX;
+                    return position + 1;
+                }
             }
 
+            return position;
+        }
+
+        /// Classic decoding with every code Width bits wide, until the width changes, a ClearCode or EOI
+        /// @return false once EOI has been read
+        template < uint64_t Width >
+        bool decompress_phase(BitReader & BitStream, std::vector<uint8_t> & dst, int64_t & prev, uint64_t & next_code,
+            uint64_t & code_width)
+        {
+            constexpr uint64_t threshold = (1ULL << Width) - (EarlyChange ? 1 : 0);
             while (true)
             {
-                code = BitStream.read(code_width);
+                if (const uint64_t left = BitStream.in.size() * 8 - BitStream.bitpos; left < Width) [[unlikely]]
+                {
+                    // earlier encoders wrote EOI one bit narrower after a last code reaching the threshold
+                    if (left == Width - 1 && BitStream.read(left) == EOICode) return false;
+                    if constexpr (!RequireEOI) return false;
+                    throw std::out_of_range("EOF");
+                }
+
+                const uint64_t code = BitStream.template read<Width>();
                 if (code == EOICode) {
-                    break;
+                    return false;
                 }
 
                 if (code == ClearCode) {
-                    init_dict();
-                    code_width = MinimumCodeSize + 1;
-                    next_code = FirstFreeCode;
+                    next_code = base_next_code_;
+                    code_width = encoder_width(next_code);
                     prev = -1;
-                    continue;
+                    return true;
                 }
 
-                std::string entry;
-                if (auto it = dictionary.find(code); it != dictionary.end()) {
-                    entry = it->second;
-                } else {
-                    if (prev == -1 || code != next_code) {
-                        throw std::invalid_argument("Corrupted LZW stream (invalid code)");
-                    }
-                    const std::string& prev_entry = dictionary[static_cast<uint64_t>(prev)];
-                    entry = prev_entry;
-                    entry.push_back(prev_entry[0]);
+                // KwKwK: code refers to the entry that is about to be added
+                const bool pending_entry = code >= next_code || (code >= ClearCode && code < FirstFreeCode);
+                if (pending_entry && (prev == -1 || code != next_code || next_code > MaxCode)) {
+                    throw std::invalid_argument("Corrupted LZW stream (invalid code)");
                 }
 
+                // The encoder adds its first entry right after the first code, ahead of us
+                bool widen = prev == -1;
                 if (prev != -1 && next_code <= MaxCode)
                 {
-                    const std::string prev_entry = dictionary[prev];
-                    std::string new_entry = prev_entry;
-                    new_entry.push_back(entry[0]);
-                    dictionary[next_code] = new_entry;
+                    decoder_prefix_[next_code] = static_cast<uint32_t>(prev);
+                    decoder_suffix_[next_code] = pending_entry ? decoder_first_[prev] : decoder_first_[code];
+                    decoder_first_[next_code] = decoder_first_[prev];
+                    decoder_length_[next_code] = decoder_length_[prev] + 1;
                     ++next_code;
+                    widen = true;
+                }
 
+                // Add entry to output
+                emit_decoder_entry(code, dst);
+                prev = static_cast<int64_t>(code);
+
+                if constexpr (Width < LZWMaxBitSize) {
+                    if (widen && next_code >= threshold) {
+                        code_width = Width + 1;
+                        return true;
+                    }
+                }
+            }
+        }
+
+    public:
+        /// Create an unbound codec, use compress(src, dst) and decompress(src, dst)
+        lzw() = default;
+
+        /// Create a codec bound to a pair of buffers, use compress() and decompress()
+        lzw(const std::vector<uint8_t> & input, std::vector<uint8_t> & output)
+            : bound_input_(&input), bound_output_(&output) { }
+
+        lzw(const lzw &) = delete;
+        lzw & operator=(const lzw &) = delete;
+
+        /// Compress bound input into bound output
+        void compress() { compress(*bound_input_, *bound_output_); }
+
+        /// Decompress bound input into bound output
+        void decompress() { decompress(*bound_input_, *bound_output_); }
+
+        /// Start every dictionary, and every dictionary after a ClearCode, with preset entries instead of only
+        /// the single symbols. Entry i gets code FirstFreeCode + i and extends prefixes[i] by suffixes[i].
+        /// Both ends of a stream must use the same preset
+        /// @param prefixes Prefix code of each entry, a single symbol or an earlier entry
+        /// @param suffixes Symbol appended to the prefix
+        /// @throws std::invalid_argument Entries do not form a valid dictionary
+        void set_preset(const std::span<const uint32_t> prefixes, const std::span<const uint8_t> suffixes)
+        {
+            if (prefixes.size() != suffixes.size() || FirstFreeCode + prefixes.size() > MaxCode) {
+                throw std::invalid_argument("LZW preset does not fit the dictionary");
+            }
+
+            prepare_decoder_table();
+            preset_keys_.clear();
+            for (uint64_t i = 0; i < prefixes.size(); i++)
+            {
+                const uint64_t code = FirstFreeCode + i;
+                const uint32_t prefix = prefixes[i];
+                if (prefix >= code || (prefix >= ClearCode && prefix < FirstFreeCode) || suffixes[i] >= ClearCode) {
+                    throw std::invalid_argument("LZW preset entry " + std::to_string(i) + " is invalid");
+                }
+
+                preset_keys_.push_back((prefix << 8) | suffixes[i]);
+                decoder_prefix_[code] = prefix;
+                decoder_suffix_[code] = suffixes[i];
+                if constexpr (Growth == growth_t::LZMW) decoder_tail_[code] = suffixes[i];
+                decoder_first_[code] = decoder_first_[prefix];
+                decoder_length_[code] = decoder_length_[prefix] + 1;
+            }
+
+            base_next_code_ = FirstFreeCode + prefixes.size();
+            encoder_table_.clear(); // rebuilt with the preset on next use
+            node_code_.clear();
+            encoder_next_code_ = 0;
+            decoder_next_code_ = 0;
+        }
+
+        /// Choose what compress() does with a full dictionary
+        void set_reset_policy(const reset_policy_t policy) noexcept { reset_policy_ = policy; }
+
+        /// Number of ClearCodes emitted mid-stream by the last compress() because the dictionary was full
+        [[nodiscard]] uint64_t dictionary_resets() const noexcept { return dictionary_resets_; }
+
+        /// Compress src into dst, dst is overwritten
+        /// @param src Input data
+        /// @param dst Output buffer, its capacity is reused
+        /// @param continue_dictionary Keep the dictionary left by the previous compress() instead of starting
+        ///        with a ClearCode. Such a stream only decodes with decompress(..., true) right after its predecessor
+        /// @throws std::logic_error Nothing to continue
+        void compress(const std::span<const uint8_t> src, std::vector<uint8_t> & dst, const bool continue_dictionary = false)
+        {
+            dst.clear();
+            BitWriter BitStream(dst);
+            dictionary_resets_ = 0;
+
+            uint64_t code_width = MinimumCodeSize + 1;
+            uint64_t next_code = FirstFreeCode;
+            if (continue_dictionary)
+            {
+                if (encoder_next_code_ == 0) {
+                    throw std::logic_error("No LZW dictionary to continue");
+                }
+
+                code_width = encoder_code_width_;
+                next_code = encoder_next_code_;
+            }
+            else
+            {
+                reset_encoder_table();
+                BitStream.write(ClearCode, code_width);
+                next_code = base_next_code_;
+                code_width = encoder_width(next_code);
+                monitor_input_ = 0;
+                monitor_bits_ = 0;
+                monitor_window_input_ = UINT64_MAX;
+                monitor_best_ = UINT64_MAX;
+            }
+
+            encoder_next_code_ = 0;
+
+            uint64_t eoi_width = 0;
+            if constexpr (Growth != growth_t::Classic) {
+                compress_grown(src, BitStream, next_code, code_width);
+                eoi_width = code_width;
+            }
+            else
+            {
+                uint32_t w = NoEntry;
+                for (uint64_t position = 0; position < src.size();) {
+                    with_width(code_width, [&]<uint64_t Width>() {
+                        position = compress_phase<Width>(src, position, w, next_code, code_width, BitStream);
+                    });
+                }
+
+                eoi_width = code_width;
+                if (w != NoEntry)
+                {
+                    BitStream.write(w, code_width);
+
+                    // Once the decoder reads the last code it holds every entry, and it widens on reaching the
+                    // threshold where the encoder only widens past it. EOI is read with the decoder's width
                     const uint64_t threshold = (1ULL << code_width) - (EarlyChange ? 1 : 0);
                     if (next_code >= threshold && code_width < LZWMaxBitSize) {
-                        ++code_width;
+                        eoi_width = code_width + 1;
                     }
                 }
+            }
 
-                // Add entry to output
-                if (output_.capacity() < entry.size() + output_.size()) {
-                    output_.reserve(std::max(output_.size() * 2, entry.size() + output_.size()));
+            BitStream.write(EOICode, eoi_width);
+            encoder_next_code_ = next_code;
+            encoder_code_width_ = code_width;
+            monitor_input_ += src.size();
+            monitor_bits_ += BitStream.bitpos;
+        }
+
+        /// Decompress src into dst, dst is overwritten
+        /// @param src LZW stream
+        /// @param dst Output buffer, its capacity is reused
+        /// @param continue_dictionary src was compressed with continue_dictionary, right after the stream decoded last
+        /// @throws std::invalid_argument Corrupted stream
+        /// @throws std::out_of_range Stream ended before EOI
+        /// @throws std::logic_error Nothing to continue
+        void decompress(const std::span<const uint8_t> src, std::vector<uint8_t> & dst, const bool continue_dictionary = false)
+        {
+            dst.clear();
+            dst.reserve(src.size());
+            prepare_decoder_table();
+            BitReader BitStream(src);
+            uint64_t code_width = MinimumCodeSize + 1;
+            uint64_t next_code = FirstFreeCode;
+            if (continue_dictionary)
+            {
+                if (decoder_next_code_ == 0) {
+                    throw std::logic_error("No LZW dictionary to continue");
                 }
-                output_.insert(output_.end(), entry.begin(), entry.end());
-                prev = static_cast<int64_t>(code);
+
+                // No entry is pending at a stream boundary, so the first code has the encoder's width
+                next_code = decoder_next_code_;
+                code_width = encoder_width(next_code);
+            }
+            else
+            {
+                // Read first code (should be clear)
+                if (BitStream.read(code_width) != ClearCode) {
+                    throw std::invalid_argument("Invalid LZW format!");
+                }
+
+                next_code = base_next_code_;
+                code_width = encoder_width(next_code);
+            }
+
+            decoder_next_code_ = 0;
+            if constexpr (Growth != growth_t::Classic)
+            {
+                decompress_grown(BitStream, dst, next_code, code_width);
+                decoder_next_code_ = next_code;
+            }
+            else
+            {
+                int64_t prev = -1;  // Using -1 as sentinel for "no previous"
+                for (bool more = true; more;) {
+                    with_width(code_width, [&]<uint64_t Width>() {
+                        more = decompress_phase<Width>(BitStream, dst, prev, next_code, code_width);
+                    });
+                }
+
+                decoder_next_code_ = next_code;
             }
         }
     };
 
+    /// LZW growing its dictionary by whole previous-current match pairs
+    template < uint64_t LZWMaxBitSize >
+    using lzmw = lzw < LZWMaxBitSize, false, 8, const_two_power(LZWMaxBitSize) - 1, 256, 257, 258,
+        (1 << LZWMaxBitSize) - 1, growth_t::LZMW >;
+
+    /// LZW growing its dictionary by the previous match followed by every prefix of the current one
+    template < uint64_t LZWMaxBitSize >
+    using lzap = lzw < LZWMaxBitSize, false, 8, const_two_power(LZWMaxBitSize) - 1, 256, 257, 258,
+        (1 << LZWMaxBitSize) - 1, growth_t::LZAP >;
+
+    /// TIFF LZW (Compression = 5) as libtiff writes it: codes of 9 to 12 bits packed highest bit first,
+    /// widened one code early, and no code past 4093 so a ClearCode always comes before 4094.
+    /// Strips missing their EOI decode up to their last whole code. Keep the Immediate reset policy
+    /// for streams other decoders read
+    using tiff_lzw = lzw < 12, true, 8, 4095, 256, 257, 258, 4093, growth_t::Classic, bit_order_t::MSB, false >;
+
     constexpr uint8_t reverse_bits(const uint8_t x)
     {
         constexpr uint8_t lookup[16] = {0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe, 0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf};
@@ -324,394 +1056,537 @@ namespace lzw
             }
         };
 
+        /// 256-bit symbol presence bitmap backed by a fixed array
+        class symbol_bitmap_t : public bitmap_base
+        {
+        public:
+            std::array < uint8_t, MaxCodexLimit / 8 > bitmap_data { };
+
+            symbol_bitmap_t()
+            {
+                init_data_array = [this](const uint64_t)->bool
+                {
+                    data_array_ = bitmap_data.data();
+                    return true;
+                };
+
+                init(MaxCodexLimit);
+            }
+        };
+
+        /// Tree node in the node pool. Leaves carry a symbol, internal nodes carry pool indices of their children
         struct HuffmanNode
         {
-            uint64_t symbol_;
             uint64_t frequency_;
-            explicit HuffmanNode(const uint64_t symbol, const uint64_t frequency)
-                : symbol_(symbol), frequency_(frequency) { }
-
-            HuffmanNode * left_ = nullptr;
-            HuffmanNode * right_ = nullptr;
-            bool connected_to_the_tree = false;
-
-            [[nodiscard]] bool operator >(const HuffmanNode & Node) const { return frequency_ > Node.frequency_; }
-            [[nodiscard]] bool operator <(const HuffmanNode & Node) const { return frequency_ < Node.frequency_; }
-            [[nodiscard]] bool operator >=(const HuffmanNode & Node) const { return frequency_ >= Node.frequency_; }
-            [[nodiscard]] bool operator <=(const HuffmanNode & Node) const { return frequency_ <= Node.frequency_; }
-            [[nodiscard]] bool operator ==(const HuffmanNode & Node) const { return frequency_ == Node.frequency_; }
+            uint16_t symbol_;
+            int16_t left_ = -1;
+            int16_t right_ = -1;
         };
 
-        std::list < HuffmanNode > huffman_list;
-        std::vector <uint8_t> input_;
-        std::vector <uint8_t> & output_;
-        HuffmanNode * root = nullptr;
-        struct symbol_rep_t
+        /// Decoder trie node, children are pool indices, or symbols if DecoderLeaf is set. 0 means no child
+        static constexpr uint16_t DecoderLeaf = 0x8000;
+        struct decoder_node_t
         {
-            std::vector<uint8_t> data_buffer{};
-            uint64_t data_bits = 0;
+            uint16_t child[2];
+        };
 
-            bool operator==(const symbol_rep_t & rep) const {
-                return (rep.data_bits == data_bits) && (data_buffer == rep.data_buffer);
-            }
+        const std::vector <uint8_t> * bound_input_ = nullptr;
+        std::vector <uint8_t> * bound_output_ = nullptr;
 
-            bool operator!=(const symbol_rep_t & rep) const {
-                return !((rep.data_bits == data_bits) && (data_buffer == rep.data_buffer));
-            }
-        };
+        // per-instance scratch, kept across calls so repeated blocks do not allocate
+        histogram_t frequency_ { };
+        std::vector < HuffmanNode > huffman_nodes_;
+        std::vector < int16_t > leaves_;
+        std::vector < decoder_node_t > decoder_trie_;
+        int16_t root = -1;
 
-    public:
-        lzw_dictionary_t < uint64_t, symbol_rep_t > symbol_map;
+        /// Flat code table, bit i of a code is the i-th branch taken from root
+        std::array < uint64_t, MaxCodexLimit > code_ { };
+        std::array < uint8_t, MaxCodexLimit > code_bits_ { };
 
-    private:
-        void sort()
+        std::vector <uint8_t> table_raw_;
+        std::vector <uint8_t> table_packed_;
+        lzw<12> table_codec_;
+
+        /// Preset code table, used instead of a per-block table whenever that is smaller
+        static constexpr uint8_t PresetTableMarker = 0xDD;
+        std::array < uint64_t, MaxCodexLimit > preset_code_ { };
+        std::array < uint8_t, MaxCodexLimit > preset_code_bits_ { };
+        std::vector < decoder_node_t > preset_trie_;
+        bool has_preset_ = false;
+
+        void load_input_into_huffman_list(const std::span<const uint8_t> input)
         {
-            huffman_list.sort([&](const HuffmanNode & a, const HuffmanNode & b)->bool
+            frequency_.fill(0);
+            cpu::kernels().histogram(input, frequency_);
+
+            for (uint64_t sym = 0; sym < MaxCodexLimit; sym++)
             {
-                if (a.connected_to_the_tree || b.connected_to_the_tree) {
-                    return a.connected_to_the_tree < b.connected_to_the_tree;
+                if (frequency_[sym] != 0) {
+                    leaves_.push_back(static_cast<int16_t>(huffman_nodes_.size()));
+                    huffman_nodes_.push_back({ .frequency_ = frequency_[sym], .symbol_ = static_cast<uint16_t>(sym) });
                 }
-                return a <= b;
+            }
+
+            std::ranges::stable_sort(leaves_, [this](const int16_t a, const int16_t b)->bool {
+                return huffman_nodes_[a].frequency_ < huffman_nodes_[b].frequency_;
             });
         }
 
-        void load_input_into_huffman_list()
+        /// Two-queue construction: sorted leaves and merged nodes are both consumed in frequency order
+        void make_huffman_tree_from_huffman_list()
         {
-            lzw_dictionary_t < uint8_t, uint64_t > frequency_map;
-            for (const auto c : input_) {
-                frequency_map[c]++;
+            uint64_t leaf_pos = 0;
+            auto merged_pos = static_cast<int16_t>(huffman_nodes_.size());
+            auto pick = [&]()->int16_t
+            {
+                const bool merged_available = merged_pos < static_cast<int16_t>(huffman_nodes_.size());
+                if (leaf_pos < leaves_.size() && (!merged_available
+                    || huffman_nodes_[leaves_[leaf_pos]].frequency_ <= huffman_nodes_[merged_pos].frequency_))
+                {
+                    return leaves_[leaf_pos++];
+                }
+
+                return merged_pos++;
+            };
+
+            for (uint64_t i = 1; i < leaves_.size(); i++)
+            {
+                const auto left = pick();
+                const auto right = pick();
+                huffman_nodes_.push_back({
+                    .frequency_ = huffman_nodes_[left].frequency_ + huffman_nodes_[right].frequency_,
+                    .symbol_ = 0,
+                    .left_ = left,
+                    .right_ = right });
             }
 
-            for (const auto [sym, freq] : frequency_map) {
-                huffman_list.emplace_back(sym, freq);
+            root = static_cast<int16_t>(huffman_nodes_.size() - 1);
+        }
+
+        void walk_huffman_tree(const int16_t parent, const uint64_t code, const uint64_t bpos)
+        {
+            const auto & node = huffman_nodes_[parent];
+            if (node.left_ == -1) {
+                if (bpos > 58) throw std::runtime_error("Huffman code too long");
+                code_[node.symbol_] = code;
+                code_bits_[node.symbol_] = static_cast<uint8_t>(bpos);
+                return;
             }
 
-            sort();
+            walk_huffman_tree(node.left_, code, bpos + 1);
+            walk_huffman_tree(node.right_, code | (1ULL << bpos), bpos + 1);
         }
 
-        void make_huffman_tree_from_huffman_list()
+        /// Rebuild a binary trie from a code table
+        /// @throws std::runtime_error Table is not a valid prefix code
+        static void build_decoder_trie(const std::array < uint64_t, MaxCodexLimit > & code,
+            const std::array < uint8_t, MaxCodexLimit > & code_bits, std::vector < decoder_node_t > & trie)
         {
-            uint64_t next_code = MaxCodexLimit;
-            auto assign = [this, &next_code](decltype(huffman_list)::iterator & it, const decltype(huffman_list)::iterator * cannot = nullptr)->bool
+            trie.reserve(2 * MaxCodexLimit); // children are written through references while the trie grows
+            trie.assign(1, decoder_node_t { });
+            for (uint64_t sym = 0; sym < MaxCodexLimit; sym++)
             {
-                while ((it)->connected_to_the_tree || (cannot && (it == *cannot)) || ((it)->symbol_ == next_code))
+                const auto bits = code_bits[sym];
+                if (bits == 0) continue;
+
+                uint64_t node = 0;
+                for (uint64_t i = 0; i < bits; i++)
                 {
-                    ++it;
-                    if (it == huffman_list.end())
+                    uint16_t & child = trie[node].child[(code[sym] >> i) & 1];
+                    if (i + 1 == bits) {
+                        if (child != 0) throw std::runtime_error("Huffman table is invalid");
+                        child = static_cast<uint16_t>(DecoderLeaf | sym);
+                        break;
+                    }
+
+                    if (child == 0)
                     {
-                        return false;
+                        if (trie.size() >= 2 * MaxCodexLimit) throw std::runtime_error("Huffman table is invalid");
+                        child = static_cast<uint16_t>(trie.size());
+                        trie.push_back({ });
+                    } else if (child & DecoderLeaf) {
+                        throw std::runtime_error("Huffman table is invalid");
                     }
-                }
 
-                return true;
-            };
+                    node = child;
+                }
+            }
+        }
 
-            decltype(huffman_list)::iterator left;
-            while (true)
+        static void decode_using_constructed_pairs(const std::vector < decoder_node_t > & trie,
+            const uint8_t * input_stream, const uint64_t bits, std::vector<uint8_t> & output)
+        {
+            uint64_t node = 0;
+            for (uint64_t offset = 0; offset < bits; offset++)
             {
-                auto it = huffman_list.begin();
-                left = it;
-                auto right = ++it;
-                if (!assign(left)) break;
-                if (!assign(right, &left)) break;
-                auto * left_ptr = &*left;
-                auto * right_ptr = &*right;
-                huffman_list.emplace_back(next_code++, (left)->frequency_ + (right)->frequency_);
-                auto & newNode = huffman_list.back();
-
-                newNode.left_ = left_ptr;
-                newNode.right_ = right_ptr;
-                left_ptr->connected_to_the_tree = true;
-                right_ptr->connected_to_the_tree = true;
-                sort();
-            }
-
-            if ((left)->connected_to_the_tree) throw std::runtime_error("Internal BUG");
-            root = &*left;
-        }
-
-        void walk_huffman_tree(const HuffmanNode * parent, const std::vector<uint8_t> & code_, const uint64_t bpos)
-        {
-            auto walk_child = [&](
-                const HuffmanNode * child,
-                const uint64_t p_symbol,
-                const std::vector<uint8_t> & p_code,
-                const uint64_t p_bpos,
-                const bool bit)
-            {
-                if (child) {
-                    std::vector<uint8_t> code = p_code;
-                    BitWriterLSB writer(code);
-                    writer.bitpos = p_bpos;
-                    writer.write(bit, 1);
-                    walk_huffman_tree(child, code, writer.bitpos);
+                const uint16_t child = trie[node].child[(input_stream[offset >> 3] >> (offset & 7)) & 1];
+                if (child & DecoderLeaf) {
+                    output.push_back(static_cast<uint8_t>(child));
+                    node = 0;
+                } else if (child == 0) {
+                    throw std::runtime_error("Corrupted Huffman stream");
                 } else {
-                    // already the end, push symbol
-                    symbol_map[p_symbol] = {
-                        .data_buffer = p_code,
-                        .data_bits = p_bpos
-                    };
+                    node = child;
                 }
-            };
+            }
 
-            walk_child(parent->left_, parent->symbol_, code_, bpos, false);
-            walk_child(parent->right_, parent->symbol_, code_, bpos, true);
+            if (node != 0) throw std::runtime_error("Corrupted Huffman stream");
         }
 
-        void decode_using_constructed_pairs(const std::vector<uint8_t> & input_stream, const uint64_t bits)
+        template < typename Type >
+        static void append_numeric(std::vector<uint8_t> & output, const Type value)
         {
-            uint64_t offset = 0;
-            uint64_t current_bit_size = 1;
-            lzw_dictionary_t < uint64_t, uint8_t > flipped_pairs;
+            output.insert(output.end(), reinterpret_cast<const uint8_t *>(&value),
+                reinterpret_cast<const uint8_t *>(&value) + sizeof(value));
+        }
 
-            auto numeric_to_uint64_t = [](const uint64_t & result, const uint64_t & data_bits)->uint64_t
-            {
-                const uint64_t bits_ = data_bits << 58; // lower 58 bits are available for symbols
-                // higher 6 bits can describe how much lower bits are used, which should be more than enough
-                return result | bits_;
-            };
+    public:
+        /// Create an unbound codec, use compress(src, dst) and decompress(src, dst)
+        Huffman()
+        {
+            huffman_nodes_.reserve(2 * MaxCodexLimit);
+            leaves_.reserve(MaxCodexLimit);
+            decoder_trie_.reserve(2 * MaxCodexLimit);
+        }
+
+        /// Create a codec bound to a pair of buffers, use compress() and decompress()
+        Huffman (const std::vector<uint8_t> & input, std::vector <uint8_t> & output) : Huffman()
+        {
+            bound_input_ = &input;
+            bound_output_ = &output;
+        }
+
+        Huffman(const Huffman &) = delete;
+        Huffman & operator=(const Huffman &) = delete;
 
-            auto vec_to_uint64_t = [&numeric_to_uint64_t](const symbol_rep_t & vec)
+        /// Drop the state of the previous block, keeping every buffer allocated
+        void reset()
+        {
+            huffman_nodes_.clear();
+            leaves_.clear();
+            code_.fill(0);
+            code_bits_.fill(0);
+            root = -1;
+        }
+
+        std::vector < uint64_t > export_symbols()
+        {
+            std::vector < uint64_t > ret;
+            for (uint64_t sym = 0; sym < MaxCodexLimit; sym++)
             {
-                uint64_t result = 0;
-                std::memcpy(&result, vec.data_buffer.data(), vec.data_buffer.size());
-                return numeric_to_uint64_t(result, vec.data_bits);
-            };
+                if (code_bits_[sym] != 0) {
+                    ret.push_back(code_[sym] | static_cast<uint64_t>(code_bits_[sym]) << 58);
+                }
+            }
+
+            return ret;
+        }
+
+        /// Compress bound input into bound output
+        void compress() { compress(*bound_input_, *bound_output_); }
+
+        /// Decompress bound input into bound output
+        void decompress() { decompress(*bound_input_, *bound_output_); }
 
-            for (const auto & [byte, bitStream] : symbol_map) {
-                flipped_pairs.emplace(vec_to_uint64_t(bitStream), byte);
+        /// Build the code table for src, replacing the current one
+        /// @param src Input data
+        /// @return Number of distinct symbols. With less than two symbols no code is assigned
+        uint64_t build_table(const std::span<const uint8_t> src)
+        {
+            reset();
+            load_input_into_huffman_list(src);
+            if (leaves_.size() > 1) {
+                make_huffman_tree_from_huffman_list();
+                walk_huffman_tree(root, 0, 0);
+            }
+
+            return leaves_.size();
+        }
+
+        /// Length of the bit stream encode() would produce for the data the current table was built from
+        /// @return Bits
+        [[nodiscard]] uint64_t encoded_bits() const noexcept
+        {
+            uint64_t bits = 0;
+            for (uint64_t sym = 0; sym < MaxCodexLimit; sym++) {
+                bits += frequency_[sym] * code_bits_[sym];
             }
 
-            BitReaderLSB reader(input_stream);
-            auto can_find_reference = [&](const uint64_t bit_offset, const uint64_t bit_size, uint8_t & decoded)->bool
+            return bits;
+        }
+
+        /// Occurrences of each symbol in the data the current table was built from
+        [[nodiscard]] const histogram_t & symbol_frequency() const noexcept { return frequency_; }
+
+        /// Append [UINT64: BIT COUNT][BitSteam] of src, encoded with the current code table, to dst
+        /// @param src Data the current table was built from, every symbol must have a code
+        /// @param dst Output buffer
+        void encode(const std::span<const uint8_t> src, std::vector<uint8_t> & dst) const
+        {
+            /// bit count is patched in once known
+            const uint64_t bits_written_offset = dst.size();
+            append_numeric(dst, static_cast<uint64_t>(0));
+
+            alignas(64) std::array < uint64_t, MaxCodexLimit > table;
+            uint64_t longest = 0;
+            for (uint64_t sym = 0; sym < MaxCodexLimit; sym++)
             {
-                reader.bitpos = bit_offset;
-                const auto current_reference = reader.read(bit_size);
-                const auto key = numeric_to_uint64_t(current_reference, bit_size);
-                const auto reference = flipped_pairs.find(key);
+                table[sym] = code_[sym] | static_cast<uint64_t>(code_bits_[sym]) << CodeLengthShift;
+                longest = std::max<uint64_t>(longest, code_bits_[sym]);
+            }
 
-                if (reference == flipped_pairs.end()) {
-                    return false;
-                }
+            // room for every symbol at the longest length, plus the slack of the last 64-bit store
+            const uint64_t stream_offset = dst.size();
+            dst.resize(stream_offset + (src.size() * longest + 7) / 8 + sizeof(uint64_t));
+            code_packer_t packer { .out = dst.data() + stream_offset, .acc = 0, .fill = 0 };
+            cpu::kernels().pack_codes(src, table.data(), longest, packer);
 
-                decoded = (reference->second);
-                return true;
-            };
+            const uint64_t bits_written = static_cast<uint64_t>(packer.out - (dst.data() + stream_offset)) * 8 + packer.fill;
+            dst.resize(stream_offset + (bits_written + 7) / 8);
+            std::memcpy(dst.data() + bits_written_offset, &bits_written, sizeof(bits_written));
+        }
 
-            while (offset < bits)
+        /// Append the stream header for the current code table to dst
+        /// @param src_size Size of the data the table was built from
+        /// @param dst Output buffer
+        /// @return true if the data stream has to follow (encode()), false if the header alone describes the data
+        bool write_table(const uint64_t src_size, std::vector<uint8_t> & dst)
+        {
+            if (leaves_.size() <= 1)
             {
-                uint8_t decoded = 0;
-                while (!can_find_reference(offset, current_bit_size, decoded)) {
-                    current_bit_size++;
-                }
+                dst.push_back(0x00);
+                dst.push_back(leaves_.empty() ? 0 : static_cast<uint8_t>(huffman_nodes_[leaves_.front()].symbol_));
+                append_numeric(dst, src_size);
+                return false;
+            }
 
-                output_.push_back(decoded);
-                offset += current_bit_size;
-                current_bit_size = 1;
+            bool table_packed = false;
+            if (has_preset_ && use_preset(table_packed))
+            {
+                dst.push_back(PresetTableMarker);
+                code_ = preset_code_;
+                code_bits_ = preset_code_bits_;
+                return true;
             }
-        }
 
-    public:
-        Huffman (std::vector<uint8_t> input, std::vector <uint8_t> & output) : input_(std::move(input)), output_(output) { }
+            if (!table_packed) pack_table();
+            const auto table_size = static_cast<uint16_t>(table_packed_.size());
 
-        std::vector < uint64_t > export_symbols()
+            // write to buffer
+            dst.push_back(0xAA);
+            append_numeric(dst, table_size);
+            dst.insert(dst.end(), table_packed_.begin(), table_packed_.end());
+            return true;
+        }
+
+        /// Code lengths every block may use without storing a table, or none.
+        /// Codes are assigned canonically in symbol order, so both ends only need the lengths
+        /// @param lengths Code length of each symbol, 0 for symbols without a code. Empty clears the preset
+        /// @throws std::runtime_error Lengths do not form a prefix code
+        void set_preset(const std::span<const uint8_t> lengths)
         {
-            std::vector < uint64_t > ret;
-            std::vector < std::pair <uint64_t, symbol_rep_t > > map;
-            map.insert_range(map.end(), symbol_map);
-            std::ranges::sort(map, [](const auto & a, const auto & b)->bool{ return a.first < b.first; });
-            std::ranges::for_each(map | std::views::values, [&](const symbol_rep_t & p) {
-                uint64_t val = 0;
-                std::memcpy(&val, p.data_buffer.data(), p.data_buffer.size());
-                val |= p.data_bits << 58;
-                ret.push_back(val);
-            });
+            has_preset_ = false;
+            preset_code_.fill(0);
+            preset_code_bits_.fill(0);
+            if (lengths.empty()) return;
+            if (lengths.size() != MaxCodexLimit) throw std::runtime_error("Huffman preset needs 256 code lengths");
+
+            std::array < uint64_t, 60 > count { };
+            for (const auto length : lengths)
+            {
+                if (length > 58) throw std::runtime_error("Huffman preset is invalid");
+                count[length]++;
+            }
 
-            return ret;
+            count[0] = 0;
+            std::array < uint64_t, 60 > next { };
+            for (uint64_t length = 1, code = 0; length < next.size(); length++)
+            {
+                code = (code + count[length - 1]) << 1;
+                next[length] = code;
+            }
+
+            for (uint64_t sym = 0; sym < MaxCodexLimit; sym++)
+            {
+                const auto length = lengths[sym];
+                if (length == 0) continue;
+
+                const uint64_t code = next[length]++;
+                if (code >> length) throw std::runtime_error("Huffman preset is invalid");
+
+                // canonical codes are read most significant bit first, the table stores the first branch in bit 0
+                for (uint64_t i = 0; i < length; i++) {
+                    preset_code_[sym] |= ((code >> (length - 1 - i)) & 1) << i;
+                }
+
+                preset_code_bits_[sym] = length;
+            }
+
+            build_decoder_trie(preset_code_, preset_code_bits_, preset_trie_);
+            has_preset_ = true;
         }
 
-        void compress()
+    private:
+        /// Whether the preset codes the current data smaller than its own table does
+        /// @param table_packed Set if the own table had to be packed to decide
+        bool use_preset(bool & table_packed)
         {
-            output_.clear();
-            // construct Huffman table
-            load_input_into_huffman_list();
-            if (huffman_list.size() == 1)
+            uint64_t preset_bits = 0;
+            for (uint64_t sym = 0; sym < MaxCodexLimit; sym++)
             {
-                output_.push_back(0x00);
-                output_.push_back(static_cast<uint8_t>(huffman_list.front().symbol_));
-                const uint64_t len = input_.size();
-                output_.insert_range(output_.end(), std::vector<uint8_t>{(uint8_t*)&len, (uint8_t*)&len+sizeof(uint64_t)});
-                return;
+                if (frequency_[sym] == 0) continue;
+                if (preset_code_bits_[sym] == 0) return false;
+                preset_bits += frequency_[sym] * preset_code_bits_[sym];
             }
 
-            output_.push_back(0xAA);
-            make_huffman_tree_from_huffman_list();
-            walk_huffman_tree(root, {}, 0);
+            // an own table costs at least its size field, so a preset no longer than the bare stream wins outright
+            const uint64_t own_bytes = (encoded_bits() + 7) / 8;
+            const uint64_t preset_bytes = (preset_bits + 7) / 8;
+            if (preset_bytes <= own_bytes + sizeof(uint16_t)) return true;
 
+            pack_table();
+            table_packed = true;
+            return preset_bytes <= own_bytes + sizeof(uint16_t) + table_packed_.size();
+        }
+
+        /// Serialize the current code table into table_packed_
+        void pack_table()
+        {
             // write huffman table
             // [UINT8: SYMBOLS]         0: 256, positive integers: 1 - 255
             // [32 BYTE SYMBOL BITMAP]
             // [UINT8]                  [BIT SIZE], [SYMBOLS] in len
             // [[PACKED BITS]...]
             // [BitSteam]
-            std::vector<uint8_t> huffman_table, symbol_bitmap(256 / 8, 0);
-            class sym_pos_bitmap_t : public bitmap_base
-            {
-            public:
-                explicit sym_pos_bitmap_t(std::vector < uint8_t > & bitmap_data)
-                {
-                    init_data_array = [&](const uint64_t)->bool
-                    {
-                        data_array_ = bitmap_data.data();
-                        return true;
-                    };
+            symbol_bitmap_t sym_pos_bitmap;
 
-                    init(256);
-                }
-            } sym_pos_bitmap(symbol_bitmap);
-
-            if (symbol_map.size() > 256) throw std::runtime_error("WTF");
             // 1. record size
-            huffman_table.push_back(symbol_map.size() == 256 ? 0 : static_cast<uint8_t>(symbol_map.size()));
-
-            // 2. sort unordered_map
-            std::vector < std::pair < uint64_t, symbol_rep_t > > map;
-            map.insert_range(map.end(), symbol_map);
-            std::ranges::sort(map, [](const std::pair < uint64_t, symbol_rep_t > & a, const std::pair < uint64_t, symbol_rep_t > & b)->bool {
-                return a.first < b.first;
-            });
+            table_raw_.clear();
+            table_raw_.push_back(leaves_.size() == 256 ? 0 : static_cast<uint8_t>(leaves_.size()));
+            table_raw_.resize(1 + sym_pos_bitmap.bitmap_data.size());
 
-            // 3. record bitmap and push the bit size
-            for (const auto & [sym, rep] : map)
+            // 2. record bitmap and push the bit size, in symbol order
+            for (uint64_t sym = 0; sym < MaxCodexLimit; sym++)
             {
-                if (rep.data_bits > 255 || sym > 255) throw std::runtime_error("WTF");
+                if (code_bits_[sym] == 0) continue;
                 sym_pos_bitmap.set_bit(sym, true);
-                huffman_table.push_back(*reinterpret_cast<const uint8_t *>(&rep.data_bits));
+                table_raw_.push_back(code_bits_[sym]);
             }
-            huffman_table.insert_range(huffman_table.begin() + 1, symbol_bitmap); // add bitmap after symbol size
+            std::ranges::copy(sym_pos_bitmap.bitmap_data, table_raw_.begin() + 1); // add bitmap after symbol size
 
-            // 4. write packed bits
-            std::vector<uint8_t> huffman_table_val_section; // [[PACKED BITS]...]
-            BitWriterLSB table_val_sec_writer(huffman_table_val_section);
-            for (const auto &[data_buffer, data_bits] : map | std::views::values)
+            // 3. write packed bits
+            BitWriterLSB table_val_sec_writer(table_raw_);
+            table_val_sec_writer.bitpos = table_raw_.size() * 8;
+            for (uint64_t sym = 0; sym < MaxCodexLimit; sym++)
             {
-                uint64_t data = 0;
-                std::memcpy(&data, data_buffer.data(), data_buffer.size());
-                table_val_sec_writer.write(data, data_bits);
+                if (code_bits_[sym] != 0) {
+                    table_val_sec_writer.write(code_[sym], code_bits_[sym]);
+                }
             }
-            huffman_table.insert(huffman_table.end(), huffman_table_val_section.begin(), huffman_table_val_section.end());
 
             // now, compress the whole table
-            std::vector<uint8_t> compressed_huffman_table;
-            lzw<12> LZW(huffman_table, compressed_huffman_table);
-            LZW.compress();
-            const auto table_size = static_cast<uint16_t>(compressed_huffman_table.size());
+            table_codec_.compress(table_raw_, table_packed_);
+        }
 
-            // write to buffer
-            output_.insert_range(output_.end(),
-                std::vector<uint8_t>{ reinterpret_cast<const uint8_t *>(&table_size),
-                    reinterpret_cast<const uint8_t *>(&table_size) + sizeof(table_size)
-                });
-            output_.insert_range(output_.end(), compressed_huffman_table);
+    public:
 
-            /// ready to encode actual data
-            std::vector<uint8_t> encoded_huffman_stream;
-            uint64_t bits_written = 0;
-            BitWriterLSB writer(encoded_huffman_stream);
+        /// Compress src into dst, dst is overwritten
+        /// @param src Input data
+        /// @param dst Output buffer, its capacity is reused
+        void compress(const std::span<const uint8_t> src, std::vector<uint8_t> & dst)
+        {
+            dst.clear();
 
-            // encode
-            for (const auto & c : input_)
-            {
-                uint64_t data = 0;
-                const auto & [data_buffer, data_bits] = symbol_map.at(c);
-                std::memcpy(&data, data_buffer.data(), data_buffer.size());
-                writer.write(data, static_cast<int64_t>(data_bits));
-                bits_written += data_bits;
+            // construct Huffman table
+            build_table(src);
+            if (write_table(src.size(), dst)) {
+                /// ready to encode actual data
+                encode(src, dst);
             }
-
-            output_.insert_range(output_.end(), std::vector<uint8_t>
-                { reinterpret_cast<const uint8_t *>(&bits_written), reinterpret_cast<const uint8_t *>(&bits_written) + sizeof(bits_written) });
-            output_.insert_range(output_.end(), encoded_huffman_stream);
         }
 
-        void decompress()
+        /// Decompress src into dst, dst is overwritten
+        /// @param src Huffman stream
+        /// @param dst Output buffer, its capacity is reused
+        /// @throws std::runtime_error Corrupted stream
+        void decompress(const std::span<const uint8_t> src, std::vector<uint8_t> & dst)
         {
-            if (input_.empty()) return;
-            if (input_.front() == 0x00) {
-                if (input_.size() == 2 + sizeof(uint64_t)) {
+            dst.clear();
+            reset();
+
+            if (src.empty()) return;
+            if (src.front() == 0x00) {
+                if (src.size() == 2 + sizeof(uint64_t)) {
                     uint64_t len;
-                    std::memcpy(&len, input_.data() + 2, sizeof(len));
-                    output_.resize(len, input_[1]);
+                    std::memcpy(&len, src.data() + 2, sizeof(len));
+                    dst.resize(len, src[1]);
                     return;
                 }
             }
 
-            if (input_.front() != 0xAA) {
-                throw std::runtime_error("Huffman table is invalid");
+            if (src.front() == PresetTableMarker)
+            {
+                if (!has_preset_) throw std::runtime_error("Huffman block needs the preset table");
+                uint64_t stream_bits = 0;
+                if (src.size() < 1 + sizeof(stream_bits)) throw std::runtime_error("Corrupted Huffman stream");
+                std::memcpy(&stream_bits, src.data() + 1, sizeof(stream_bits));
+                if (stream_bits > (src.size() - 1 - sizeof(stream_bits)) * 8) throw std::runtime_error("Corrupted Huffman stream");
+                decode_using_constructed_pairs(preset_trie_, src.data() + 1 + sizeof(stream_bits), stream_bits, dst);
+                return;
             }
 
-            input_.erase(input_.begin());
+            if (src.front() != 0xAA || src.size() < 1 + sizeof(uint16_t)) {
+                throw std::runtime_error("Huffman table is invalid");
+            }
 
             uint16_t table_size = 0; // LZW pack size
-            std::memcpy(&table_size, input_.data(), sizeof(table_size));
-            std::vector<uint8_t> huffman_table_lzw_compressed { input_.begin() + 2, input_.begin() + 2 + table_size }, huffman_table;
-            lzw<12> Decompressor(huffman_table_lzw_compressed, huffman_table);
-            Decompressor.decompress();
-
-            /// Read symbol table
-            const int64_t symbol_count = huffman_table.front() == 0 ? 256 : huffman_table.front();
-            std::vector<uint8_t> symbol_bitmap { huffman_table.begin() + 1, huffman_table.begin() + 1 + 32 };
-            const class sym_pos_bitmap_t : public bitmap_base
-            {
-            public:
-                explicit sym_pos_bitmap_t(std::vector < uint8_t > & bitmap_data)
-                {
-                    init_data_array = [&](const uint64_t)->bool
-                    {
-                        data_array_ = bitmap_data.data();
-                        return true;
-                    };
+            std::memcpy(&table_size, src.data() + 1, sizeof(table_size));
+            const uint64_t stream_offset = 1 + sizeof(table_size) + table_size + sizeof(uint64_t);
+            if (src.size() < stream_offset) {
+                throw std::runtime_error("Huffman table is invalid");
+            }
 
-                    init(256);
-                }
-            } sym_pos_bitmap(symbol_bitmap);
+            table_codec_.decompress(src.subspan(1 + sizeof(table_size), table_size), table_raw_);
 
-            std::vector < uint8_t > huffman_table_header_section {
-                huffman_table.begin() + 1 /* symbol size */ + 32 /* symbol bitmap */,
-                huffman_table.begin() + 1 + 32 + symbol_count
-            };
-            std::ranges::reverse(huffman_table_header_section);
+            /// Read symbol table
+            if (table_raw_.empty()) throw std::runtime_error("Huffman table is invalid");
+            const uint64_t symbol_count = table_raw_.front() == 0 ? 256 : table_raw_.front();
+            symbol_bitmap_t sym_pos_bitmap;
+            if (table_raw_.size() < 1 + sym_pos_bitmap.bitmap_data.size() + symbol_count) {
+                throw std::runtime_error("Huffman table is invalid");
+            }
+            std::copy_n(table_raw_.begin() + 1, sym_pos_bitmap.bitmap_data.size(), sym_pos_bitmap.bitmap_data.begin());
 
-            const std::vector < uint8_t > huffman_table_data_section {
-                huffman_table.begin() + 1 + 32 + symbol_count,
-                huffman_table.end()
-            };
+            const uint64_t header_section = 1 /* symbol size */ + sym_pos_bitmap.bitmap_data.size() /* symbol bitmap */;
+            uint64_t header_pos = header_section;
 
             // read data by info from header section
-            BitReaderLSB reader(huffman_table_data_section);
-            for (uint64_t i = 0; i < 256; i++)
+            BitReaderLSB reader(table_raw_);
+            reader.bitpos = (header_section + symbol_count) * 8;
+            for (uint64_t i = 0; i < MaxCodexLimit; i++)
             {
                 if (sym_pos_bitmap.get_bit(i))
                 {
-                    const auto symbol = static_cast<uint8_t>(i);
-                    const uint8_t sym_len = huffman_table_header_section.back();
-                    huffman_table_header_section.pop_back();
+                    if (header_pos == header_section + symbol_count) throw std::runtime_error("Huffman table is invalid");
+                    const uint8_t sym_len = table_raw_[header_pos++];
+                    if (sym_len == 0 || sym_len > 58) throw std::runtime_error("Huffman table is invalid");
 
                     // read symbol definition
-                    auto & [data_buffer, data_bits] = symbol_map[symbol];
-                    BitWriterLSB writer(data_buffer);
-                    writer.write(reader.read(sym_len), sym_len);
-                    data_bits = sym_len;
+                    code_[i] = reader.read(sym_len);
+                    code_bits_[i] = sym_len;
                 }
             }
 
             // and now, we have reconstructed our table
-            const std::vector<uint8_t> stream_byte_size { input_.begin() + 2 + table_size,
-                input_.begin() + 2 + table_size + sizeof(uint64_t) };
-            uint64_t stream_byte_size_lit = 0;
-            std::memcpy(&stream_byte_size_lit, stream_byte_size.data(), sizeof(stream_byte_size_lit));
-            const std::vector<uint8_t> dataStream { input_.begin() + 2 + table_size + sizeof(uint64_t), input_.end() };
-            decode_using_constructed_pairs(dataStream, stream_byte_size_lit);
+            build_decoder_trie(code_, code_bits_, decoder_trie_);
+            uint64_t stream_bits = 0;
+            std::memcpy(&stream_bits, src.data() + stream_offset - sizeof(uint64_t), sizeof(stream_bits));
+            if (stream_bits > (src.size() - stream_offset) * 8) {
+                throw std::runtime_error("Corrupted Huffman stream");
+            }
+
+            decode_using_constructed_pairs(decoder_trie_, src.data() + stream_offset, stream_bits, dst);
         }
     };
 }
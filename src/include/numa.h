@@ -0,0 +1,33 @@
+#ifndef LZW_NUMA_H
+#define LZW_NUMA_H
+
+#include <cstdint>
+#include <vector>
+
+/// Thread placement and memory policy helpers. Linux only, talks to the kernel directly so no libnuma is needed.
+/// Every call degrades to a no-op returning false where the kernel or machine does not support it
+namespace lzw::numa
+{
+    /// Online NUMA nodes, {0} on machines without NUMA information
+    [[nodiscard]] std::vector<int> online_nodes();
+
+    /// CPUs this process may run on, ordered round-robin across NUMA nodes so that
+    /// the first N entries spread N workers evenly over the sockets
+    [[nodiscard]] std::vector<int> cpu_order();
+
+    /// Pin the calling thread to one CPU
+    /// @return false if the affinity could not be set
+    bool pin_current_thread(int cpu);
+
+    /// Interleave the pages of [address, address + size) across every online node.
+    /// Pages already resident keep their placement
+    /// @return false if the policy could not be applied, or there is only one node
+    bool interleave(void * address, uint64_t size);
+
+    /// Allocate pages faulted by the calling thread round-robin across every online node (true),
+    /// or back on the local node (false)
+    /// @return false if the policy could not be applied, or there is only one node
+    bool interleave_current_thread(bool enable);
+}
+
+#endif //LZW_NUMA_H
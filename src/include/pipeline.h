@@ -0,0 +1,168 @@
+#ifndef LZW_PIPELINE_H
+#define LZW_PIPELINE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <vector>
+#include "block.h"
+#include "scheduler.h"
+#include "stats.h"
+
+namespace lzw
+{
+    /// Settings a compression level stands for
+    struct compression_level_t
+    {
+        selection_t selection;
+        lz77_mode_t lz77_mode;
+        uint64_t lz77_window_log;
+        reset_policy_t reset_policy;
+        uint64_t block_size;
+        uint64_t group_blocks;
+    };
+
+    constexpr uint64_t max_compression_level = 9;
+
+    /// Settings of a compression level. Levels 1 to 6 run one codec per block, picked from its entropy, with LZ77
+    /// going from a run finder up to lazy matching over a 1 MiB window; 7 to 9 try every codec on each block,
+    /// the last two on the largest blocks in long groups. Level 1 trades ratio for speed below the default:
+    /// on text LZW suits it can come out larger than giving no level, which tries every codec on each block.
+    /// Any level also adds the 12-byte stream header that records it
+    /// @param level 1 to max_compression_level, 0 for the settings used when no level is given
+    /// @throws std::invalid_argument level is above max_compression_level
+    [[nodiscard]] compression_level_t compression_level(uint64_t level);
+
+    /// Runs block_codec over whole streams on a shared work_stealing_pool.
+    /// A stream is a container, [UINT16: SECTION SIZE][SIGNATURE][PAYLOAD] repeated per block.
+    /// Codec contexts live as long as the pipeline, so they stay warm across streams
+    class block_pipeline
+    {
+    public:
+        /// Build one codec context per pool worker, on that worker
+        /// @param pool Pool every stream runs on, must outlive the pipeline
+        /// @param stats Per-thread counters, nullptr disables recording
+        block_pipeline(work_stealing_pool & pool, stats::collector * stats);
+
+        block_pipeline(const block_pipeline &) = delete;
+        block_pipeline & operator=(const block_pipeline &) = delete;
+
+        /// Compress every following stream with a trained dictionary, its id goes into a stream header.
+        /// Streams needing this dictionary can be decompressed from now on. Call between streams only
+        /// @param dictionary Dictionary, nullptr for none. Must outlive its use by the pipeline
+        void set_dictionary(const dictionary_t * dictionary) noexcept { dictionary_ = dictionary; }
+
+        /// Choose what LZW does with a full dictionary in every following stream. Call between streams only
+        void set_reset_policy(const reset_policy_t policy) noexcept { reset_policy_ = policy; }
+
+        /// Choose the LZW variant of every following stream. Call between streams only
+        void set_growth(const growth_t growth) noexcept { growth_ = growth; }
+
+        /// Choose which codecs every following stream tries per block. Call between streams only
+        void set_selection(const selection_t selection) noexcept { selection_ = selection; }
+
+        /// Record a compression level in the stream header of every following stream, 0 for none.
+        /// It only names the settings used, decompression does not depend on it. Call between streams only
+        void set_level(const uint64_t level) noexcept { level_ = level; }
+
+        /// Also try LZ77 on every block of the following streams. Call between streams only
+        /// @param mode Match finder, Off for LZW and Huffman only
+        /// @param window_log Window of 2^window_log bytes, already checked against lz77::MinWindowLog and MaxWindowLog
+        void set_lz77(const lz77_mode_t mode, const uint64_t window_log) noexcept
+        {
+            lz77_mode_ = mode;
+            lz77_window_log_ = window_log;
+        }
+
+        /// Compress data with every worker, sections are written to output in block order
+        /// @param data Input stream
+        /// @param block_size Bytes per block, at most block_codec::max_block_size
+        /// @param output Container destination
+        /// @param group_blocks Blocks per group sharing one LZW dictionary. A group is compressed
+        ///        (and later decompressed) on one worker, 1 keeps every block independent
+        /// @return Bytes written
+        /// @throws std::runtime_error A block does not fit its 16-bit section
+        uint64_t compress(std::span<const uint8_t> data, uint64_t block_size, std::ostream & output, uint64_t group_blocks = 1);
+
+        /// Decompress a whole container with every worker, one task per group
+        /// @param container Container, as written by compress()
+        /// @param output Destination
+        /// @return Bytes written
+        /// @throws std::runtime_error, std::invalid_argument, std::out_of_range Corrupted container,
+        ///         or the container needs a dictionary other than the one set
+        uint64_t decompress(std::span<const uint8_t> container, std::ostream & output);
+
+        /// Compress data entirely on the calling worker and append the container to output.
+        /// Meant for many small streams, each one a pool task
+        /// @param worker Worker running the calling task
+        void compress_on(uint64_t worker, std::span<const uint8_t> data, uint64_t block_size, std::vector<uint8_t> & output,
+            uint64_t group_blocks = 1);
+
+        /// Decompress a whole container on the calling worker and append the result to output
+        /// @param worker Worker running the calling task
+        void decompress_on(uint64_t worker, std::span<const uint8_t> container, std::vector<uint8_t> & output);
+
+        [[nodiscard]] uint64_t lzw_blocks() const noexcept { return lzw_blocks_; }
+        [[nodiscard]] uint64_t huffman_blocks() const noexcept { return huffman_blocks_; }
+        [[nodiscard]] uint64_t lz77_blocks() const noexcept { return lz77_blocks_; }
+        [[nodiscard]] uint64_t stored_blocks() const noexcept { return stored_blocks_; }
+
+    private:
+        struct worker_context_t
+        {
+            block_codec codec;
+            std::vector<uint8_t> block;
+            std::vector<block_ref_t> index;
+            const dictionary_t * dictionary = nullptr; ///< Dictionary the codec currently starts from
+        };
+
+        work_stealing_pool & pool_;
+        stats::collector * stats_;
+        const dictionary_t * dictionary_ = nullptr;
+        reset_policy_t reset_policy_ = reset_policy_t::Immediate;
+        growth_t growth_ = growth_t::Classic;
+        lz77_mode_t lz77_mode_ = lz77_mode_t::Off;
+        uint64_t lz77_window_log_ = lz77::DefaultWindowLog;
+        selection_t selection_ = selection_t::Exhaustive;
+        uint64_t level_ = 0;
+        std::vector < std::unique_ptr < worker_context_t > > contexts_;
+        std::vector < block_ref_t > index_;
+        std::vector < uint64_t > groups_;
+        std::atomic < uint64_t > lzw_blocks_ = 0;
+        std::atomic < uint64_t > huffman_blocks_ = 0;
+        std::atomic < uint64_t > lz77_blocks_ = 0;
+        std::atomic < uint64_t > stored_blocks_ = 0;
+
+        [[nodiscard]] stats::thread_stats_t * worker_stats(const uint64_t worker) const noexcept
+        {
+            return stats_ ? stats_->worker(worker) : nullptr;
+        }
+
+        [[nodiscard]] stats::thread_stats_t * main_stats() const noexcept
+        {
+            return stats_ ? stats_->main_thread() : nullptr;
+        }
+
+        /// Switch the worker's codec to a dictionary, if it is not using it already
+        void use_dictionary(uint64_t worker, const dictionary_t * dictionary);
+
+        /// Append the stream header, if the streams need one or a level was given
+        void write_stream_header(std::vector<uint8_t> & output) const;
+
+        /// Skip the stream header of a container and find the dictionary its blocks need
+        /// @throws std::runtime_error That dictionary is not set
+        const dictionary_t * stream_dictionary(std::span<const uint8_t> & container) const;
+
+        /// Compress blocks [first, last) of data as one group and append their sections to output
+        void compress_group(uint64_t worker, std::span<const uint8_t> data, uint64_t block_size,
+            uint64_t first, uint64_t last, std::vector<uint8_t> & output);
+
+        /// Decode the group of sections [first, last) of index into output, output is overwritten
+        void decompress_group(uint64_t worker, std::span<const uint8_t> container, std::span<const block_ref_t> index,
+            const dictionary_t * dictionary, std::vector<uint8_t> & output);
+    };
+}
+
+#endif //LZW_PIPELINE_H
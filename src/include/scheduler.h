@@ -0,0 +1,95 @@
+#ifndef LZW_SCHEDULER_H
+#define LZW_SCHEDULER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "stats.h"
+
+namespace lzw
+{
+    /// Fixed set of worker threads running index ranges of tasks.
+    /// Every job is split into one contiguous range per worker. A worker takes tasks from the front
+    /// of its own range, in order, and once it runs dry it steals the back half of another worker's
+    /// range, so a few expensive tasks cannot hold the other workers idle.
+    class work_stealing_pool
+    {
+    public:
+        /// @param worker Index of the worker running the task, stable for the lifetime of the pool
+        /// @param task Task index
+        using task_t = std::function<void(uint64_t worker, uint64_t task)>;
+
+        /// Start the worker threads
+        /// @param workers Number of threads, at least 1
+        explicit work_stealing_pool(uint64_t workers);
+
+        /// Cancel remaining tasks of the current job, wait for running ones and join the threads
+        ~work_stealing_pool();
+
+        work_stealing_pool(const work_stealing_pool &) = delete;
+        work_stealing_pool & operator=(const work_stealing_pool &) = delete;
+
+        [[nodiscard]] uint64_t size() const noexcept { return threads_.size(); }
+
+        /// Record idle time and steals of a worker, nullptr disables recording. Call between jobs only
+        void set_stats(uint64_t worker, stats::thread_stats_t * stats) noexcept { queues_[worker]->stats = stats; }
+
+        /// Start running task for every index in [first, last) and return immediately.
+        /// Waits for the previous job first, an error from it is dropped; call wait() to observe it
+        void submit(uint64_t first, uint64_t last, task_t task);
+
+        /// Wait until every task of the current job has finished
+        /// @throws Whatever the first failing task threw, the rest of that job is skipped
+        void wait();
+
+        /// Run fn(worker) once on every worker thread and wait for all of them, e.g. to pin a thread
+        /// or to allocate per-worker state on the node it runs on
+        /// @throws Whatever the first failing call threw
+        void for_each_worker(std::function<void(uint64_t worker)> fn);
+
+        /// Skip every task of the current job that has not started yet
+        void cancel() noexcept;
+
+        /// submit() then wait()
+        void run(const uint64_t first, const uint64_t last, task_t task)
+        {
+            submit(first, last, std::move(task));
+            wait();
+        }
+
+    private:
+        /// Remaining tasks [begin, end) of one worker
+        struct alignas(64) worker_queue_t
+        {
+            std::mutex mutex;
+            uint64_t begin = 0;
+            uint64_t end = 0;
+            bool cancelled = false;    ///< Set by cancel(), a range stolen meanwhile is dropped
+            stats::thread_stats_t * stats = nullptr;
+        };
+
+        std::vector < std::unique_ptr < worker_queue_t > > queues_;
+        std::vector < std::thread > threads_;
+
+        std::mutex mutex_;
+        std::condition_variable job_ready_;
+        std::condition_variable job_done_;
+        task_t task_;
+        std::function<void(uint64_t)> broadcast_;
+        uint64_t generation_ = 0;
+        uint64_t running_ = 0;
+        bool stop_ = false;
+        std::exception_ptr error_;
+
+        bool pop(uint64_t worker, uint64_t & task);
+        bool steal(uint64_t worker, uint64_t & task);
+        void worker_main(uint64_t worker);
+    };
+}
+
+#endif //LZW_SCHEDULER_H
@@ -0,0 +1,96 @@
+#ifndef LZW_STATS_H
+#define LZW_STATS_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/// Per-stage, per-thread instrumentation, enabled by --stats
+namespace lzw::stats
+{
+    using clock = std::chrono::steady_clock;
+
+    enum stage_t : uint64_t {
+        Read,
+        LZWEncode,
+        HuffmanTableBuild,
+        HuffmanEncode,
+        LZ77Encode,
+        Selection,
+        LZWDecode,
+        HuffmanDecode,
+        LZ77Decode,
+        Write,
+        StageCount
+    };
+
+    constexpr const char * stage_name[StageCount] = {
+        "read", "lzw_encode", "huffman_table_build", "huffman_encode", "lz77_encode", "selection", "lzw_decode",
+        "huffman_decode", "lz77_decode", "write"
+    };
+
+    struct stage_counter_t
+    {
+        uint64_t nanoseconds = 0;
+        uint64_t calls = 0;
+        uint64_t bytes_in = 0;
+        uint64_t bytes_out = 0;
+    };
+
+    /// Counters owned by exactly one thread, no synchronization inside,
+    /// padded to a cache line so neighbouring workers do not share one
+    struct alignas(64) thread_stats_t
+    {
+        std::array < stage_counter_t, StageCount > stages { };
+        uint64_t blocks = 0;
+        uint64_t dictionary_resets = 0;
+        uint64_t queue_wait_nanoseconds = 0;
+        uint64_t steals = 0;
+
+        /// Account time and traffic to a stage
+        void record(stage_t stage, clock::time_point start, clock::time_point end, uint64_t bytes_in, uint64_t bytes_out);
+
+        /// Account time spent waiting for work or for other threads
+        void wait(clock::time_point start, clock::time_point end);
+    };
+
+    /// Measures consecutive stages, does nothing without a stats sink
+    class stopwatch
+    {
+        thread_stats_t * stats_;
+        clock::time_point start_ { };
+
+    public:
+        explicit stopwatch(thread_stats_t * stats) : stats_(stats) { if (stats_) start_ = clock::now(); }
+
+        /// Account the time since construction or the last lap to a stage, and restart
+        /// @param stage Stage that just finished
+        /// @param bytes_in Bytes consumed by the stage
+        /// @param bytes_out Bytes produced by the stage
+        void lap(stage_t stage, uint64_t bytes_in, uint64_t bytes_out);
+    };
+
+    /// One thread_stats_t per worker plus one for the main thread
+    class collector
+    {
+        std::vector < thread_stats_t > workers_;
+        thread_stats_t main_;
+        clock::time_point start_;
+
+    public:
+        explicit collector(uint64_t workers) : workers_(workers), start_(clock::now()) { }
+
+        [[nodiscard]] thread_stats_t * worker(const uint64_t slot) noexcept { return &workers_[slot]; }
+        [[nodiscard]] thread_stats_t * main_thread() noexcept { return &main_; }
+
+        /// Write collected counters as JSON. Call after every worker has been joined
+        /// @param os Output stream
+        /// @param mode "compress" or "decompress"
+        void to_json(std::ostream & os, const std::string & mode) const;
+    };
+}
+
+#endif //LZW_STATS_H
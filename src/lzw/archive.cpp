@@ -0,0 +1,240 @@
+#include "archive.h"
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <streambuf>
+#include "cpu_features.h"
+
+namespace lzw::archive
+{
+    /// Forwards everything to another buffer, checksumming it on the way
+    class checksum_buffer final : public std::streambuf
+    {
+    public:
+        explicit checksum_buffer(std::streambuf * target) : target_(target) { }
+
+        [[nodiscard]] uint32_t crc() const noexcept { return crc_; }
+
+    protected:
+        std::streamsize xsputn(const char * data, const std::streamsize size) override
+        {
+            crc_ = checksum({ reinterpret_cast<const uint8_t *>(data), static_cast<uint64_t>(size) }, crc_);
+            return target_->sputn(data, size);
+        }
+
+        int_type overflow(const int_type c) override
+        {
+            if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+            const char byte = traits_type::to_char_type(c);
+            return xsputn(&byte, 1) == 1 ? c : traits_type::eof();
+        }
+
+        int sync() override { return target_->pubsync(); }
+
+    private:
+        std::streambuf * target_;
+        uint32_t crc_ = 0;
+    };
+
+    template < typename Type >
+    static void put(std::vector<uint8_t> & dst, const Type value)
+    {
+        const auto * bytes = reinterpret_cast<const uint8_t *>(&value);
+        dst.insert(dst.end(), bytes, bytes + sizeof(value));
+    }
+
+    template < typename Type >
+    static Type get(const std::span<const uint8_t> src, uint64_t & offset)
+    {
+        if (src.size() - offset < sizeof(Type)) {
+            throw std::runtime_error("Corrupted archive directory (entry exceeds directory)");
+        }
+
+        Type value;
+        std::memcpy(&value, src.data() + offset, sizeof(Type));
+        offset += sizeof(Type);
+        return value;
+    }
+
+    uint32_t checksum(const std::span<const uint8_t> data, const uint32_t prior)
+    {
+        return cpu::kernels().crc32(data, prior);
+    }
+
+    writer::writer(std::ostream & output, const uint64_t block_size, const uint64_t group_blocks)
+        : output_(output), block_size_(block_size), group_blocks_(group_blocks)
+    {
+        if (block_size == 0 || block_size > block_codec::max_block_size) {
+            throw std::invalid_argument("Block size must be between 1 and " + std::to_string(block_codec::max_block_size));
+        }
+
+        header_t header { };
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = version;
+        output_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    }
+
+    void writer::check_name(const std::string & name)
+    {
+        if (finished_) {
+            throw std::logic_error("Archive is already finished");
+        }
+
+        if (name.size() > std::numeric_limits<uint16_t>::max()) {
+            throw std::invalid_argument("Member name too long: " + name.substr(0, 64) + "...");
+        }
+
+        if (!names_.emplace(name, members_.size()).second) {
+            throw std::invalid_argument("Duplicate member name: " + name);
+        }
+    }
+
+    void writer::add(block_pipeline & pipeline, std::string name, const std::span<const uint8_t> data)
+    {
+        check_name(name);
+        const auto crc = checksum(data);
+        const auto written = pipeline.compress(data, block_size_, output_, group_blocks_);
+        members_.push_back({ std::move(name), data.size(), written, offset_, crc });
+        offset_ += written;
+    }
+
+    void writer::add_container(std::string name, const uint64_t original_size, const uint32_t crc,
+        const std::span<const uint8_t> container)
+    {
+        check_name(name);
+        output_.write(reinterpret_cast<const char *>(container.data()), static_cast<std::streamsize>(container.size()));
+        members_.push_back({ std::move(name), original_size, container.size(), offset_, crc });
+        offset_ += container.size();
+    }
+
+    void writer::finish()
+    {
+        if (finished_) return;
+        finished_ = true;
+
+        std::vector<uint8_t> directory;
+        for (const auto & member : members_)
+        {
+            put<uint16_t>(directory, static_cast<uint16_t>(member.name.size()));
+            directory.insert(directory.end(), member.name.begin(), member.name.end());
+            put<uint64_t>(directory, member.original_size);
+            put<uint64_t>(directory, member.compressed_size);
+            put<uint64_t>(directory, member.offset);
+            put<uint32_t>(directory, member.crc);
+        }
+
+        footer_t footer {
+            .directory_offset = offset_,
+            .member_count = members_.size(),
+            .directory_crc = checksum(directory),
+            .magic = { },
+        };
+        std::memcpy(footer.magic, magic, sizeof(magic));
+
+        output_.write(reinterpret_cast<const char *>(directory.data()), static_cast<std::streamsize>(directory.size()));
+        output_.write(reinterpret_cast<const char *>(&footer), sizeof(footer));
+        output_.flush();
+        if (!output_) {
+            throw std::runtime_error("Could not write archive");
+        }
+    }
+
+    reader::reader(const std::span<const uint8_t> archive) : archive_(archive)
+    {
+        header_t header { };
+        footer_t footer { };
+        if (archive.size() < sizeof(header) + sizeof(footer)) {
+            throw std::runtime_error("Not an archive (too short)");
+        }
+
+        std::memcpy(&header, archive.data(), sizeof(header));
+        std::memcpy(&footer, archive.data() + archive.size() - sizeof(footer), sizeof(footer));
+        if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || std::memcmp(footer.magic, magic, sizeof(magic)) != 0) {
+            throw std::runtime_error("Not an archive (bad magic)");
+        }
+
+        if (header.version != version) {
+            throw std::runtime_error("Unsupported archive version " + std::to_string(header.version));
+        }
+
+        const uint64_t directory_end = archive.size() - sizeof(footer);
+        if (footer.directory_offset < sizeof(header) || footer.directory_offset > directory_end) {
+            throw std::runtime_error("Corrupted archive (directory offset out of range)");
+        }
+
+        const auto directory = archive.subspan(footer.directory_offset, directory_end - footer.directory_offset);
+        if (checksum(directory) != footer.directory_crc) {
+            throw std::runtime_error("Corrupted archive (directory checksum mismatch)");
+        }
+
+        // every entry takes at least its fixed fields, which bounds the reservation
+        constexpr uint64_t min_entry = sizeof(uint16_t) + 3 * sizeof(uint64_t) + sizeof(uint32_t);
+        if (footer.member_count > directory.size() / min_entry) {
+            throw std::runtime_error("Corrupted archive (member count exceeds directory)");
+        }
+
+        members_.reserve(footer.member_count);
+        uint64_t offset = 0;
+        for (uint64_t i = 0; i < footer.member_count; i++)
+        {
+            member_t member;
+            const auto name_size = get<uint16_t>(directory, offset);
+            if (directory.size() - offset < name_size) {
+                throw std::runtime_error("Corrupted archive directory (entry exceeds directory)");
+            }
+
+            member.name.assign(reinterpret_cast<const char *>(directory.data() + offset), name_size);
+            offset += name_size;
+            member.original_size = get<uint64_t>(directory, offset);
+            member.compressed_size = get<uint64_t>(directory, offset);
+            member.offset = get<uint64_t>(directory, offset);
+            member.crc = get<uint32_t>(directory, offset);
+            if (member.offset < sizeof(header) || member.offset > footer.directory_offset
+                || member.compressed_size > footer.directory_offset - member.offset)
+            {
+                throw std::runtime_error("Corrupted archive directory (member " + member.name + " out of range)");
+            }
+
+            members_.push_back(std::move(member));
+        }
+
+        // keys view the names stored in members_, which no longer moves
+        names_.reserve(members_.size());
+        for (uint64_t i = 0; i < members_.size(); i++) {
+            names_.emplace(members_[i].name, i);
+        }
+    }
+
+    const member_t * reader::find(const std::string_view name) const
+    {
+        const auto it = names_.find(name);
+        return it == names_.end() ? nullptr : &members_[it->second];
+    }
+
+    uint64_t reader::extract(block_pipeline & pipeline, const member_t & member, std::ostream & output) const
+    {
+        checksum_buffer buffer(output.rdbuf());
+        std::ostream checked(&buffer);
+        const auto written = pipeline.decompress(container(member), checked);
+        checked.flush();
+        if (!checked || !output) {
+            throw std::runtime_error("Could not write member " + member.name);
+        }
+
+        if (written != member.original_size || buffer.crc() != member.crc) {
+            throw std::runtime_error("Checksum mismatch in member " + member.name);
+        }
+
+        return written;
+    }
+
+    void reader::extract_on(block_pipeline & pipeline, const uint64_t worker, const member_t & member,
+        std::vector<uint8_t> & output) const
+    {
+        output.clear();
+        pipeline.decompress_on(worker, container(member), output);
+        if (output.size() != member.original_size || checksum(output) != member.crc) {
+            throw std::runtime_error("Checksum mismatch in member " + member.name);
+        }
+    }
+}
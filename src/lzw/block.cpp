@@ -0,0 +1,365 @@
+#include "block.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+
+namespace lzw
+{
+    void index_blocks(const std::span<const uint8_t> container, std::vector<block_ref_t> & index)
+    {
+        index.clear();
+        uint64_t offset = 0;
+        while (offset < container.size())
+        {
+            if (container.size() - offset < sizeof(uint16_t)) {
+                throw std::runtime_error("Truncated container (incomplete section header)");
+            }
+
+            uint16_t section_size = 0;
+            std::memcpy(&section_size, container.data() + offset, sizeof(section_size));
+            offset += sizeof(section_size);
+            if (container.size() - offset < section_size) {
+                throw std::runtime_error("Truncated container (section exceeds input)");
+            }
+
+            index.push_back({ .offset = offset, .size = section_size });
+            offset += section_size;
+        }
+    }
+
+    uint64_t read_stream_header(const std::span<const uint8_t> container, stream_header_t & header)
+    {
+        if (container.size() < sizeof(stream_header_t::Magic)
+            || std::memcmp(container.data(), stream_header_t::Magic, sizeof(stream_header_t::Magic)) != 0)
+        {
+            return 0;
+        }
+
+        if (container.size() < stream_header_t::Version1Size) {
+            throw std::runtime_error("Truncated container (incomplete stream header)");
+        }
+
+        header = { };
+        std::memcpy(&header, container.data(), stream_header_t::Version1Size);
+        if (header.version == 1)
+        {
+            header.flags = stream_header_t::HasDictionary;
+            return stream_header_t::Version1Size;
+        }
+
+        if (header.version != stream_header_t::Version) {
+            throw std::runtime_error("Unsupported stream version " + std::to_string(header.version));
+        }
+
+        if (container.size() < sizeof(header)) {
+            throw std::runtime_error("Truncated container (incomplete stream header)");
+        }
+
+        std::memcpy(&header, container.data(), sizeof(header));
+        return sizeof(header);
+    }
+
+    /// Initial LZW code size for an alphabet of symbols distinct symbols, two bits at least as in GIF
+    static uint64_t alphabet_code_size(const uint64_t symbols)
+    {
+        return std::max<uint64_t>(2, std::bit_width(symbols - 1));
+    }
+
+    template < typename Call >
+    void block_codec::with_alphabet_lzw(const uint64_t symbols, Call && call)
+    {
+        const uint64_t code_size = alphabet_code_size(symbols);
+        [&]<uint64_t... Index>(std::index_sequence<Index...>) {
+            ((code_size == Index + 2 && (call(std::get<Index>(alphabet_lzw_)), true)) || ...);
+        }(std::make_index_sequence<std::tuple_size_v<decltype(alphabet_lzw_)>>());
+    }
+
+    void block_codec::set_dictionary(const dictionary_t * dictionary)
+    {
+        if (dictionary) {
+            lzw_.set_preset(dictionary->lzw_prefix, dictionary->lzw_suffix);
+            lzmw_.set_preset(dictionary->lzw_prefix, dictionary->lzw_suffix);
+            lzap_.set_preset(dictionary->lzw_prefix, dictionary->lzw_suffix);
+            huffman_.set_preset(dictionary->huffman_lengths);
+        } else {
+            lzw_.set_preset({ }, { });
+            lzmw_.set_preset({ }, { });
+            lzap_.set_preset({ }, { });
+            huffman_.set_preset({ });
+        }
+
+        has_dictionary_ = dictionary != nullptr;
+        begin_group();
+    }
+
+    void block_codec::set_lz77(const lz77_mode_t mode, const uint64_t window_log)
+    {
+        if (mode != lz77_mode_t::Off) lz77_.set_mode(mode, window_log);
+        lz77_mode_ = mode;
+        begin_group();
+    }
+
+    bool block_codec::guide_to_dictionary(const std::span<const uint8_t> src, const uint64_t huffman_bytes)
+    {
+        // a repeat costs about a length and a distance, the bytes outside repeats what Huffman spends on them
+        constexpr uint64_t RepeatBits = 24;
+        const auto repeats = repeat_probe_.measure(src);
+        const uint64_t literal_bits = (src.size() - repeats.covered) * huffman_.encoded_bits() / src.size();
+        return (literal_bits + repeats.matches * RepeatBits) / 8 < huffman_bytes;
+    }
+
+    void block_codec::set_reset_policy(const reset_policy_t policy) noexcept
+    {
+        lzw_.set_reset_policy(policy);
+        lzmw_.set_reset_policy(policy);
+        lzap_.set_reset_policy(policy);
+        std::apply([&](auto & ... codec) { (codec.set_reset_policy(policy), ...); }, alphabet_lzw_);
+    }
+
+    char block_codec::compress(const std::span<const uint8_t> src, std::vector<uint8_t> & dst, const bool carry)
+    {
+        stats::stopwatch watch(stats_);
+        output_huffman_.clear();
+        huffman_.build_table(src);
+        const bool has_table = huffman_.write_table(src.size(), output_huffman_);
+        watch.lap(stats::HuffmanTableBuild, src.size(), output_huffman_.size());
+
+        // alphabet of the block, from the symbol counts Huffman already took
+        std::array<uint8_t, alphabet_bitmap_size> alphabet { };
+        uint64_t symbols = 0;
+        const auto & frequency = huffman_.symbol_frequency();
+        for (uint64_t sym = 0; sym < frequency.size(); sym++)
+        {
+            if (frequency[sym] == 0) continue;
+            alphabet[sym >> 3] |= static_cast<uint8_t>(1 << (sym & 7));
+            symbols++;
+        }
+
+        // an alphabet group continues as long as its symbols cover the block. Once they fall short the rest of
+        // the group runs over every byte value, so a wider alphabet does not break it again and again
+        bool continued = carry && lzw_carry_;
+        if (continued && lzw_carry_ == AlphabetSignature)
+        {
+            for (uint64_t i = 0; i < alphabet.size(); i++) continued &= (alphabet[i] & ~encoder_alphabet_[i]) == 0;
+            alphabet_outgrown_ = !continued;
+        }
+
+        char lzw_signature = LZWSignature;
+        if (continued) {
+            lzw_signature = lzw_carry_;
+        } else if (growth_ != growth_t::Classic) {
+            lzw_signature = growth_ == growth_t::LZMW ? LZMWSignature : LZAPSignature;
+        } else if (!has_dictionary_ && !alphabet_outgrown_ && symbols > 0 && symbols <= max_alphabet) {
+            lzw_signature = AlphabetSignature;
+        }
+
+        // the guided selection runs one codec: Huffman, whose size its table already tells, unless the
+        // repeats of the block promise that a dictionary codec beats it
+        const bool lz77_enabled = lz77_mode_ != lz77_mode_t::Off;
+        const uint64_t huffman_bytes = output_huffman_.size() + (has_table ? sizeof(uint64_t) + (huffman_.encoded_bits() + 7) / 8 : 0);
+        bool run_lzw = selection_ == selection_t::Exhaustive;
+        bool run_lz77 = lz77_enabled && run_lzw;
+        if (selection_ == selection_t::Guided && has_table && guide_to_dictionary(src, huffman_bytes))
+        {
+            run_lz77 = lz77_enabled;
+            run_lzw = !lz77_enabled;
+        }
+
+        uint64_t resets = 0;
+        uint64_t lzw_header = 0;
+        output_lzw_.clear();
+        if (run_lzw)
+        {
+            switch (lzw_signature)
+            {
+                case LZWSignature:
+                    lzw_.compress(src, output_lzw_, continued);
+                    resets = lzw_.dictionary_resets();
+                    break;
+                case LZMWSignature:
+                    lzmw_.compress(src, output_lzw_, continued);
+                    resets = lzmw_.dictionary_resets();
+                    break;
+                case LZAPSignature:
+                    lzap_.compress(src, output_lzw_, continued);
+                    resets = lzap_.dictionary_resets();
+                    break;
+                default:
+                {
+                    if (!continued)
+                    {
+                        encoder_alphabet_ = alphabet;
+                        for (uint64_t sym = 0, rank = 0; sym < frequency.size(); sym++) {
+                            if (frequency[sym] != 0) encoder_rank_[sym] = static_cast<uint8_t>(rank++);
+                        }
+
+                        lzw_header = alphabet_bitmap_size;
+                    }
+
+                    input_ranks_.resize(src.size());
+                    std::ranges::transform(src, input_ranks_.begin(), [&](const uint8_t sym) { return encoder_rank_[sym]; });
+                    uint64_t group_symbols = 0;
+                    for (const auto byte : encoder_alphabet_) group_symbols += std::popcount(byte);
+                    with_alphabet_lzw(group_symbols, [&](auto & codec) {
+                        codec.compress(input_ranks_, output_lzw_, continued);
+                        resets = codec.dictionary_resets();
+                    });
+                    break;
+                }
+            }
+            watch.lap(stats::LZWEncode, src.size(), lzw_header + output_lzw_.size());
+        }
+
+        const bool lz77_continued = carry && lz77_carry_;
+        output_lz77_.clear();
+        if (run_lz77)
+        {
+            lz77_.compress(src, output_lz77_, lz77_continued);
+            watch.lap(stats::LZ77Encode, src.size(), output_lz77_.size());
+        } else if (lz77_enabled) {
+            lz77_.skip(src, lz77_continued);
+        }
+        lz77_carry_ = lz77_enabled;
+
+        // codecs that did not run never win
+        constexpr uint64_t NotRun = UINT64_MAX;
+        const uint64_t lzw_size = run_lzw ? lzw_header + output_lzw_.size() : NotRun;
+        const uint64_t lz77_size = run_lz77 ? output_lz77_.size() : NotRun;
+        uint64_t huffman_size = NotRun;
+        if (selection_ != selection_t::Guided || std::min(lzw_size, lz77_size) >= huffman_bytes)
+        {
+            if (has_table) {
+                huffman_.encode(src, output_huffman_);
+                watch.lap(stats::HuffmanEncode, src.size(), output_huffman_.size());
+            }
+
+            huffman_size = output_huffman_.size();
+        }
+
+        // LZ77 is kept only when it is strictly smaller, so the other codecs win every tie, and so do all of them against storing
+        const bool use_stored = src.size() < std::min({ lz77_size, lzw_size, huffman_size });
+        const bool use_lz77 = !use_stored && lz77_size < std::min(lzw_size, huffman_size);
+        const bool use_lzw = !use_stored && !use_lz77 && huffman_size > lzw_size;
+        std::span<const uint8_t> buffer = output_huffman_;
+        char signature = HuffmanSignature;
+        if (use_stored) {
+            buffer = src;
+            signature = StoredSignature;
+        } else if (use_lz77) {
+            buffer = output_lz77_;
+            signature = lz77_continued ? LZ77ContinuedSignature : LZ77Signature;
+        } else if (use_lzw) {
+            buffer = output_lzw_;
+            signature = continued ? LZWContinuedSignature : lzw_signature;
+        }
+
+        lzw_carry_ = use_lzw ? lzw_signature : 0;
+        if (lz77_enabled && starts_group(signature)) {
+            lz77_.restart_history_at_last_block();
+        }
+
+        dst.clear();
+        dst.reserve(buffer.size() + lzw_header + 1);
+        dst.push_back(signature);
+        if (use_lzw) dst.insert(dst.end(), encoder_alphabet_.begin(), encoder_alphabet_.begin() + static_cast<int64_t>(lzw_header));
+        dst.insert(dst.end(), buffer.begin(), buffer.end());
+        watch.lap(stats::Selection, lzw_header + output_lzw_.size() + output_huffman_.size() + output_lz77_.size(), dst.size());
+
+        if (stats_) {
+            stats_->blocks++;
+            stats_->dictionary_resets += resets;
+        }
+
+        return signature;
+    }
+
+    void block_codec::decompress(const std::span<const uint8_t> src, std::vector<uint8_t> & dst)
+    {
+        if (src.empty()) {
+            dst.clear();
+            return;
+        }
+
+        stats::stopwatch watch(stats_);
+        const bool continued = src.front() == LZWContinuedSignature;
+        if (continued && !lzw_decoded_) {
+            throw std::runtime_error("Continued LZW block without the block before it");
+        }
+
+        const char variant = continued ? lzw_decoded_ : src.front();
+        lzw_decoded_ = 0;
+        switch (variant)
+        {
+            case HuffmanSignature:
+                huffman_.decompress(src.subspan(1), dst);
+                watch.lap(stats::HuffmanDecode, src.size(), dst.size());
+                break;
+            case LZWSignature:
+                lzw_.decompress(src.subspan(1), dst, continued);
+                break;
+            case LZMWSignature:
+                lzmw_.decompress(src.subspan(1), dst, continued);
+                break;
+            case LZAPSignature:
+                lzap_.decompress(src.subspan(1), dst, continued);
+                break;
+            case AlphabetSignature:
+            {
+                auto payload = src.subspan(1);
+                if (!continued)
+                {
+                    if (payload.size() < alphabet_bitmap_size) {
+                        throw std::invalid_argument("Corrupted block (truncated alphabet)");
+                    }
+
+                    decoder_alphabet_size_ = 0;
+                    decoder_symbols_.fill(0);
+                    for (uint64_t sym = 0; sym < decoder_symbols_.size(); sym++) {
+                        if (payload[sym >> 3] & (1 << (sym & 7))) decoder_symbols_[decoder_alphabet_size_++] = static_cast<uint8_t>(sym);
+                    }
+
+                    if (decoder_alphabet_size_ == 0 || decoder_alphabet_size_ > max_alphabet) {
+                        throw std::invalid_argument("Corrupted block (invalid alphabet)");
+                    }
+
+                    payload = payload.subspan(alphabet_bitmap_size);
+                }
+
+                with_alphabet_lzw(decoder_alphabet_size_, [&](auto & codec) { codec.decompress(payload, dst, continued); });
+                for (auto & byte : dst) byte = decoder_symbols_[byte];
+                break;
+            }
+            case StoredSignature:
+                dst.assign(src.begin() + 1, src.end());
+                break;
+            case LZ77Signature:
+            case LZ77ContinuedSignature:
+                lz77_.decompress(src.subspan(1), dst, variant == LZ77ContinuedSignature);
+                watch.lap(stats::LZ77Decode, src.size(), dst.size());
+                break;
+            default:
+                throw std::invalid_argument("Unknown block signature");
+        }
+
+        // LZ77 blocks later in the group may reach into the output of any codec
+        const bool lz77_variant = variant == LZ77Signature || variant == LZ77ContinuedSignature;
+        if (!lz77_variant && keep_lz77_history_) lz77_.append_history(dst, continued);
+
+        if (variant != HuffmanSignature && variant != StoredSignature && !lz77_variant) {
+            lzw_decoded_ = variant;
+            watch.lap(stats::LZWDecode, src.size(), dst.size());
+        }
+
+        if (stats_) stats_->blocks++;
+    }
+
+    void block_codec::reset()
+    {
+        huffman_.reset();
+        output_lzw_.clear();
+        output_huffman_.clear();
+        output_lz77_.clear();
+        begin_group();
+    }
+}
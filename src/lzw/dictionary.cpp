@@ -0,0 +1,261 @@
+#include "dictionary.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <queue>
+#include <stdexcept>
+#include <unordered_map>
+#include "cppcrc.h"
+
+namespace lzw
+{
+    static constexpr char dictionary_magic[4] = { 'L', 'Z', 'W', 'D' };
+    static constexpr uint32_t dictionary_version = 1;
+
+    /// Trained dictionaries seed the 12-bit block dictionary after its 256 symbols and two control codes
+    static constexpr uint64_t first_phrase_code = 258;
+    static constexpr uint64_t dictionary_codes = 4096;
+
+    /// Node of the phrase trie built while training
+    struct phrase_t
+    {
+        uint32_t parent;
+        uint32_t length;
+        uint64_t uses;
+        uint8_t symbol;
+    };
+
+    /// Huffman code lengths for the given symbol weights, every weight must be positive
+    static std::array<uint8_t, 256> code_lengths(const std::array<uint64_t, 256> & weights)
+    {
+        using entry_t = std::pair<uint64_t, uint32_t>; // weight, node
+        std::priority_queue<entry_t, std::vector<entry_t>, std::greater<>> queue;
+        std::vector<uint32_t> parent(256, 0);
+        for (uint32_t sym = 0; sym < 256; sym++) queue.emplace(weights[sym], sym);
+
+        while (queue.size() > 1)
+        {
+            const auto [left_weight, left] = queue.top();
+            queue.pop();
+            const auto [right_weight, right] = queue.top();
+            queue.pop();
+            const auto node = static_cast<uint32_t>(parent.size());
+            parent.push_back(node);
+            parent[left] = node;
+            parent[right] = node;
+            queue.emplace(left_weight + right_weight, node);
+        }
+
+        std::array<uint8_t, 256> lengths { };
+        for (uint32_t sym = 0; sym < 256; sym++)
+        {
+            uint64_t depth = 0;
+            for (uint32_t node = sym; parent[node] != node; node = parent[node]) depth++;
+            if (depth > 58) throw std::runtime_error("Training data too skewed for a Huffman preset");
+            lengths[sym] = static_cast<uint8_t>(depth);
+        }
+
+        return lengths;
+    }
+
+    static std::vector<uint8_t> serialize_body(const dictionary_t & dictionary)
+    {
+        std::vector<uint8_t> body;
+        auto put = [&](const auto value)
+        {
+            const auto offset = body.size();
+            body.resize(offset + sizeof(value));
+            std::memcpy(body.data() + offset, &value, sizeof(value));
+        };
+
+        put(static_cast<uint16_t>(dictionary.lzw_prefix.size()));
+        for (uint64_t i = 0; i < dictionary.lzw_prefix.size(); i++)
+        {
+            put(static_cast<uint16_t>(dictionary.lzw_prefix[i]));
+            put(dictionary.lzw_suffix[i]);
+        }
+
+        body.insert(body.end(), dictionary.huffman_lengths.begin(), dictionary.huffman_lengths.end());
+        return body;
+    }
+
+    dictionary_t train_dictionary(const std::span<const std::span<const uint8_t>> samples, const uint64_t block_size,
+        const uint64_t max_phrases)
+    {
+        if (max_phrases > dictionary_codes - first_phrase_code - 1) {
+            throw std::invalid_argument("At most " + std::to_string(dictionary_codes - first_phrase_code - 1) + " phrases fit the dictionary");
+        }
+
+        if (block_size == 0) {
+            throw std::invalid_argument("Block size must be at least 1");
+        }
+
+        // Parse every block as the encoder would and count how often each phrase is emitted.
+        // Phrases live in one trie across blocks, a phrase only matches in a block that has built it itself
+        std::vector<phrase_t> phrases(256);
+        std::vector<uint64_t> built_in(256, 0);
+        for (uint32_t sym = 0; sym < 256; sym++) phrases[sym] = { .parent = sym, .length = 1, .uses = 0, .symbol = static_cast<uint8_t>(sym) };
+        std::unordered_map<uint64_t, uint32_t> children;
+        std::array<uint64_t, 256> frequency { };
+        uint64_t generation = 0;
+
+        for (const auto & sample : samples)
+        {
+            for (uint64_t offset = 0; offset < sample.size(); offset += block_size)
+            {
+                const auto block = sample.subspan(offset, std::min(block_size, sample.size() - offset));
+                uint64_t next_code = first_phrase_code;
+                uint32_t w = UINT32_MAX;
+                generation++;
+                for (const auto k : block)
+                {
+                    frequency[k]++;
+                    if (w == UINT32_MAX) {
+                        w = k;
+                        continue;
+                    }
+
+                    const uint64_t key = (static_cast<uint64_t>(w) << 8) | k;
+                    const auto child = children.find(key);
+                    if (child != children.end() && built_in[child->second] == generation) {
+                        w = child->second;
+                        continue;
+                    }
+
+                    phrases[w].uses++;
+                    if (next_code < dictionary_codes)
+                    {
+                        uint32_t node = 0;
+                        if (child == children.end())
+                        {
+                            node = static_cast<uint32_t>(phrases.size());
+                            phrases.push_back({ .parent = w, .length = phrases[w].length + 1, .uses = 0, .symbol = k });
+                            built_in.push_back(0);
+                            children.emplace(key, node);
+                        } else {
+                            node = child->second;
+                        }
+
+                        built_in[node] = generation;
+                        next_code++;
+                    } else {
+                        // dictionary full, the encoder starts over and builds it again
+                        generation++;
+                        next_code = first_phrase_code;
+                    }
+
+                    w = k;
+                }
+
+                if (w != UINT32_MAX) phrases[w].uses++;
+            }
+        }
+
+        // Keep the phrases saving the most symbols, each together with the prefixes it is built from
+        std::vector<uint32_t> candidates;
+        for (uint32_t node = 256; node < phrases.size(); node++) {
+            if (phrases[node].uses > 0) candidates.push_back(node);
+        }
+
+        auto score = [&](const uint32_t node) { return phrases[node].uses * (phrases[node].length - 1); };
+        std::ranges::sort(candidates, [&](const uint32_t a, const uint32_t b) {
+            return score(a) != score(b) ? score(a) > score(b) : a < b;
+        });
+
+        std::vector<bool> selected(phrases.size(), false);
+        std::vector<uint32_t> kept, chain;
+        for (const auto node : candidates)
+        {
+            if (kept.size() == max_phrases) break;
+
+            chain.clear();
+            for (uint32_t n = node; n >= 256 && !selected[n]; n = phrases[n].parent) chain.push_back(n);
+            if (kept.size() + chain.size() > max_phrases) continue;
+
+            for (const auto n : chain) selected[n] = true;
+            kept.insert(kept.end(), chain.begin(), chain.end());
+        }
+
+        // prefixes before the phrases extending them
+        std::ranges::sort(kept, [&](const uint32_t a, const uint32_t b) {
+            return phrases[a].length != phrases[b].length ? phrases[a].length < phrases[b].length : a < b;
+        });
+
+        dictionary_t dictionary;
+        std::unordered_map<uint32_t, uint32_t> code_of;
+        for (uint64_t i = 0; i < kept.size(); i++)
+        {
+            const auto & phrase = phrases[kept[i]];
+            dictionary.lzw_prefix.push_back(phrase.parent < 256 ? phrase.parent : code_of.at(phrase.parent));
+            dictionary.lzw_suffix.push_back(phrase.symbol);
+            code_of[kept[i]] = static_cast<uint32_t>(first_phrase_code + i);
+        }
+
+        // every symbol keeps a code, so any block can use the preset
+        std::array<uint64_t, 256> weights { };
+        for (uint64_t sym = 0; sym < 256; sym++) weights[sym] = frequency[sym] + 1;
+        dictionary.huffman_lengths = code_lengths(weights);
+
+        const auto body = serialize_body(dictionary);
+        dictionary.id = CRC32::CRC32::calc(body.data(), body.size());
+        return dictionary;
+    }
+
+    void save_dictionary(const dictionary_t & dictionary, const std::string & path)
+    {
+        std::ofstream file(path, std::ios::binary);
+        const auto body = serialize_body(dictionary);
+        file.write(dictionary_magic, sizeof(dictionary_magic));
+        file.write(reinterpret_cast<const char *>(&dictionary_version), sizeof(dictionary_version));
+        file.write(reinterpret_cast<const char *>(&dictionary.id), sizeof(dictionary.id));
+        file.write(reinterpret_cast<const char *>(body.data()), static_cast<std::streamsize>(body.size()));
+        if (!file.flush()) {
+            throw std::runtime_error("Could not write dictionary " + path);
+        }
+    }
+
+    dictionary_t load_dictionary(const std::string & path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Could not open dictionary " + path);
+        }
+
+        const std::vector<uint8_t> data { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+        constexpr uint64_t header_size = sizeof(dictionary_magic) + sizeof(dictionary_version) + sizeof(uint32_t);
+        if (data.size() < header_size + sizeof(uint16_t) || std::memcmp(data.data(), dictionary_magic, sizeof(dictionary_magic)) != 0) {
+            throw std::runtime_error(path + " is not a dictionary");
+        }
+
+        uint32_t version = 0;
+        dictionary_t dictionary;
+        std::memcpy(&version, data.data() + sizeof(dictionary_magic), sizeof(version));
+        std::memcpy(&dictionary.id, data.data() + sizeof(dictionary_magic) + sizeof(version), sizeof(dictionary.id));
+        if (version != dictionary_version) {
+            throw std::runtime_error("Unsupported dictionary version " + std::to_string(version));
+        }
+
+        const auto body = std::span(data).subspan(header_size);
+        uint16_t phrases = 0;
+        std::memcpy(&phrases, body.data(), sizeof(phrases));
+        constexpr uint64_t phrase_size = sizeof(uint16_t) + sizeof(uint8_t);
+        if (body.size() != sizeof(phrases) + phrases * phrase_size + dictionary.huffman_lengths.size()
+            || CRC32::CRC32::calc(body.data(), body.size()) != dictionary.id)
+        {
+            throw std::runtime_error("Corrupted dictionary " + path);
+        }
+
+        for (uint64_t i = 0; i < phrases; i++)
+        {
+            uint16_t prefix = 0;
+            const auto * entry = body.data() + sizeof(phrases) + i * phrase_size;
+            std::memcpy(&prefix, entry, sizeof(prefix));
+            dictionary.lzw_prefix.push_back(prefix);
+            dictionary.lzw_suffix.push_back(entry[sizeof(prefix)]);
+        }
+
+        std::ranges::copy(body.last(dictionary.huffman_lengths.size()), dictionary.huffman_lengths.begin());
+        return dictionary;
+    }
+}
@@ -0,0 +1,380 @@
+#include "lz77.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+
+namespace lzw
+{
+    static uint32_t load32(const uint8_t * data)
+    {
+        uint32_t value = 0;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    /// Bytes a and b have in common, at most max_length
+    static uint64_t common_length(const uint8_t * a, const uint8_t * b, const uint64_t max_length)
+    {
+        uint64_t length = 0;
+        for (; length + sizeof(uint64_t) <= max_length; length += sizeof(uint64_t))
+        {
+            uint64_t x = 0, y = 0;
+            std::memcpy(&x, a + length, sizeof(x));
+            std::memcpy(&y, b + length, sizeof(y));
+            if (x != y) {
+                const auto differ = x ^ y;
+                return length + (std::endian::native == std::endian::little ? std::countr_zero(differ) : std::countl_zero(differ)) / 8;
+            }
+        }
+
+        while (length < max_length && a[length] == b[length]) length++;
+        return length;
+    }
+
+    /// Elias gamma code of value + 1: as many zeros as it has bits after the leading one, then those bits
+    static void write_gamma(BitWriterLSB & writer, const uint64_t value)
+    {
+        const uint64_t coded = value + 1;
+        const uint64_t bits = std::bit_width(coded);
+        writer.write(1ULL << (bits - 1), bits);
+        writer.write(coded, bits - 1);
+    }
+
+    static uint64_t read_gamma(BitReaderLSB & reader)
+    {
+        uint64_t zeros = 0;
+        while (reader.read(1) == 0) {
+            if (++zeros > 32) throw std::invalid_argument("Corrupted block (invalid LZ77 length)");
+        }
+
+        return ((1ULL << zeros) | reader.read(zeros)) - 1;
+    }
+
+    void lz77::set_mode(const lz77_mode_t mode, const uint64_t window_log)
+    {
+        if (window_log < MinWindowLog || window_log > MaxWindowLog) {
+            throw std::invalid_argument("LZ77 window must be between 2^" + std::to_string(MinWindowLog)
+                + " and 2^" + std::to_string(MaxWindowLog) + " bytes");
+        }
+
+        mode_ = mode == lz77_mode_t::Off ? lz77_mode_t::Greedy : mode;
+        switch (mode_)
+        {
+            case lz77_mode_t::Fast:
+                max_chain_ = 1;
+                nice_length_ = 32;
+                break;
+            case lz77_mode_t::Lazy:
+                max_chain_ = 128;
+                nice_length_ = 258;
+                break;
+            default:
+                max_chain_ = 16;
+                nice_length_ = 64;
+                break;
+        }
+        window_log_ = window_log;
+        reset();
+    }
+
+    void lz77::reset() noexcept
+    {
+        buffer_begin_ += static_cast<uint32_t>(buffer_.size());
+        buffer_.clear();
+        history_begin_ = block_begin_ = next_insert_ = buffer_begin_;
+
+        window_.clear();
+        history_bytes_ = 0;
+        history_window_log_ = MaxWindowLog;
+        has_history_ = false;
+    }
+
+    uint64_t lz77::max_distance(const uint64_t history, const uint64_t offset) const noexcept
+    {
+        return std::min<uint64_t>(1ULL << window_log_, history + offset);
+    }
+
+    void lz77::insert(const uint64_t index)
+    {
+        const auto position = static_cast<uint32_t>(buffer_begin_ + index);
+        auto & head = head_[(load32(buffer_.data() + index) * 2654435761u) >> (32 - HashBits)];
+        prev_[position & (prev_.size() - 1)] = head;
+        head = position;
+    }
+
+    lz77::match_t lz77::find_and_insert(const uint64_t index, const uint64_t max_length, const uint64_t max_distance)
+    {
+        const auto position = static_cast<uint32_t>(buffer_begin_ + index);
+        const uint8_t * here = buffer_.data() + index;
+        uint32_t candidate = head_[(load32(here) * 2654435761u) >> (32 - HashBits)];
+        insert(index);
+        next_insert_ = position + 1;
+
+        // the search window is one byte short of a full one, so a chain never meets a slot overwritten since
+        match_t best { .length = MinMatch - 1, .distance = 0 };
+        const uint64_t limit = position - std::min<uint64_t>(max_distance, prev_.size() - 1);
+        for (uint64_t chain = max_chain_; chain > 0 && candidate != NoPosition && candidate >= limit; chain--)
+        {
+            const uint8_t * there = buffer_.data() + (candidate - buffer_begin_);
+            if (there[best.length] == here[best.length] && load32(there) == load32(here))
+            {
+                const uint64_t length = common_length(there, here, max_length);
+                if (length > best.length)
+                {
+                    best = { .length = length, .distance = position - candidate };
+                    if (length >= nice_length_ || length == max_length) break;
+                }
+            }
+
+            const uint32_t next = prev_[candidate & (prev_.size() - 1)];
+            if (next >= candidate) break;
+            candidate = next;
+        }
+
+        return best.distance == 0 ? match_t { .length = 0, .distance = 0 } : best;
+    }
+
+    void lz77::slide(const uint64_t incoming)
+    {
+        // keep one window before the next block and the positions still waiting for their hash,
+        // the rest goes once it is as large as what stays
+        const uint64_t window = prev_.size();
+        const uint64_t end = buffer_begin_ + buffer_.size();
+        const uint64_t keep = std::min<uint64_t>(std::max<uint64_t>(history_begin_, end > window ? end - window : 0), next_insert_);
+        const uint64_t drop = keep > buffer_begin_ ? keep - buffer_begin_ : 0;
+        if (drop > 0 && drop >= buffer_.size() - drop)
+        {
+            buffer_.erase(buffer_.begin(), buffer_.begin() + static_cast<int64_t>(drop));
+            buffer_begin_ += static_cast<uint32_t>(drop);
+        }
+
+        // positions are 32-bit, move every one down by whole windows so chain slots stay where they are
+        constexpr uint64_t PositionLimit = 1ULL << 31;
+        if (buffer_begin_ + buffer_.size() + incoming < PositionLimit) return;
+
+        const auto shift = static_cast<uint32_t>((buffer_begin_ - 1) & ~(window - 1));
+        auto move_down = [shift](uint32_t & position) { position = position > shift ? position - shift : NoPosition; };
+        std::ranges::for_each(head_, move_down);
+        std::ranges::for_each(prev_, move_down);
+        buffer_begin_ -= shift;
+        history_begin_ = std::max<uint32_t>(history_begin_ - std::min(history_begin_, shift), 1);
+        block_begin_ -= std::min(block_begin_, shift);
+        next_insert_ -= shift;
+    }
+
+    uint64_t lz77::begin_block(const std::span<const uint8_t> src, const bool continue_history)
+    {
+        if (src.size() > MaxBlockSize) {
+            throw std::invalid_argument("LZ77 blocks are at most " + std::to_string(MaxBlockSize) + " bytes");
+        }
+
+        if (head_.empty()) head_.assign(1ULL << HashBits, NoPosition);
+        if (prev_.size() != 1ULL << window_log_) prev_.assign(1ULL << window_log_, NoPosition);
+
+        if (!continue_history)
+        {
+            buffer_begin_ += static_cast<uint32_t>(buffer_.size());
+            buffer_.clear();
+            history_begin_ = next_insert_ = buffer_begin_;
+        }
+
+        slide(src.size());
+        block_begin_ = static_cast<uint32_t>(buffer_begin_ + buffer_.size());
+        const uint64_t start = buffer_.size();
+        buffer_.insert(buffer_.end(), src.begin(), src.end());
+        return start;
+    }
+
+    void lz77::skip(const std::span<const uint8_t> src, const bool continue_history)
+    {
+        begin_block(src, continue_history);
+
+        // hashing waits for the next compress(), which only reaches back one window
+        const uint64_t end = buffer_begin_ + buffer_.size();
+        if (end > prev_.size()) next_insert_ = std::max<uint32_t>(next_insert_, static_cast<uint32_t>(end - prev_.size()));
+    }
+
+    void lz77::compress(const std::span<const uint8_t> src, std::vector<uint8_t> & dst, const bool continue_history)
+    {
+        const uint64_t start = begin_block(src, continue_history);
+        const uint64_t end = buffer_.size();
+        const uint64_t history = block_begin_ - history_begin_;
+
+        // the last positions of the block before could not be hashed without the bytes of this one
+        for (; next_insert_ < block_begin_ && next_insert_ - buffer_begin_ + MinMatch <= end; next_insert_++) {
+            insert(next_insert_ - buffer_begin_);
+        }
+
+        literals_.clear();
+        tokens_.clear();
+        extra_.clear();
+        BitWriterLSB extra(extra_);
+        uint64_t literal_begin = start;
+        auto emit = [&](const uint64_t index, const match_t match)
+        {
+            const uint64_t run = index - literal_begin;
+            const uint64_t length = match.length == 0 ? 0 : match.length - MinMatch;
+            literals_.insert(literals_.end(), buffer_.begin() + static_cast<int64_t>(literal_begin), buffer_.begin() + static_cast<int64_t>(index));
+            tokens_.push_back(static_cast<uint8_t>(std::min<uint64_t>(run, 15) << 4 | std::min<uint64_t>(length, 15)));
+            if (run >= 15) write_gamma(extra, run - 15);
+            if (match.length == 0) return;
+
+            if (length >= 15) write_gamma(extra, length - 15);
+            extra.write(match.distance - 1, std::bit_width(max_distance(history, index - start) - 1));
+        };
+
+        uint64_t i = start;
+        uint64_t misses = 0;
+        while (i + MinMatch <= end)
+        {
+            match_t match = find_and_insert(i, end - i, max_distance(history, i - start));
+            if (match.length == 0) {
+                // the fast finder steps over data without repeats faster the longer it lasts
+                i += mode_ == lz77_mode_t::Fast ? 1 + (misses++ >> 5) : 1;
+                continue;
+            }
+
+            misses = 0;
+
+            // a longer match one byte later is worth a literal
+            while (mode_ == lz77_mode_t::Lazy && match.length < nice_length_ && i + 1 + MinMatch <= end)
+            {
+                const match_t next = find_and_insert(i + 1, end - i - 1, max_distance(history, i + 1 - start));
+                if (next.length <= match.length) break;
+                match = next;
+                i++;
+            }
+
+            emit(i, match);
+            i += match.length;
+            literal_begin = i;
+            for (; next_insert_ - buffer_begin_ < i && next_insert_ - buffer_begin_ + MinMatch <= end; next_insert_++) {
+                insert(next_insert_ - buffer_begin_);
+            }
+        }
+
+        emit(end, { .length = 0, .distance = 0 });
+
+        dst.clear();
+        dst.push_back(static_cast<uint8_t>(window_log_));
+        dst.push_back(0);
+        uint8_t flags = 0;
+        if (append_stream(literals_, dst)) flags |= LiteralsCoded;
+        if (append_stream(tokens_, dst)) flags |= TokensCoded;
+        dst[1] = flags;
+        dst.insert(dst.end(), extra_.begin(), extra_.end());
+    }
+
+    bool lz77::append_stream(const std::vector<uint8_t> & stream, std::vector<uint8_t> & dst)
+    {
+        huffman_.compress(stream, coded_);
+        const bool coded = coded_.size() < stream.size();
+        const auto & data = coded ? coded_ : stream;
+        const auto size = static_cast<uint16_t>(data.size());
+        dst.insert(dst.end(), reinterpret_cast<const uint8_t *>(&size), reinterpret_cast<const uint8_t *>(&size) + sizeof(size));
+        dst.insert(dst.end(), data.begin(), data.end());
+        return coded;
+    }
+
+    uint64_t lz77::read_stream(const std::span<const uint8_t> src, const bool coded, std::vector<uint8_t> & out)
+    {
+        uint16_t size = 0;
+        if (src.size() < sizeof(size)) throw std::invalid_argument("Corrupted block (truncated LZ77 stream)");
+        std::memcpy(&size, src.data(), sizeof(size));
+        if (src.size() - sizeof(size) < size) throw std::invalid_argument("Corrupted block (truncated LZ77 stream)");
+
+        const auto data = src.subspan(sizeof(size), size);
+        if (coded) {
+            huffman_.decompress(data, out);
+        } else {
+            out.assign(data.begin(), data.end());
+        }
+
+        return sizeof(size) + size;
+    }
+
+    void lz77::append_history(const std::span<const uint8_t> block, const bool continue_history)
+    {
+        // until an LZ77 block tells the window of the stream, the largest one has to be kept
+        const uint64_t window = 1ULL << history_window_log_;
+        if (!continue_history)
+        {
+            window_.clear();
+            history_bytes_ = 0;
+        }
+        else if (window_.size() > 2 * window) {
+            window_.erase(window_.begin(), window_.end() - static_cast<int64_t>(window));
+        }
+
+        window_.insert(window_.end(), block.begin(), block.end());
+        history_bytes_ += block.size();
+        has_history_ = true;
+    }
+
+    void lz77::decompress(const std::span<const uint8_t> src, std::vector<uint8_t> & dst, const bool continue_history)
+    {
+        if (continue_history && !has_history_) {
+            throw std::runtime_error("Continued LZ77 block without the block before it");
+        }
+
+        if (src.size() < 2) throw std::invalid_argument("Corrupted block (truncated LZ77 header)");
+        const uint64_t window_log = src[0];
+        const uint8_t flags = src[1];
+        if (window_log < MinWindowLog || window_log > MaxWindowLog || (flags & ~(LiteralsCoded | TokensCoded)) != 0) {
+            throw std::invalid_argument("Corrupted block (invalid LZ77 header)");
+        }
+
+        uint64_t offset = 2;
+        offset += read_stream(src.subspan(offset), flags & LiteralsCoded, literals_);
+        offset += read_stream(src.subspan(offset), flags & TokensCoded, tokens_);
+        BitReaderLSB extra(src.subspan(offset));
+
+        // decoded straight into the history, which then holds the block at its end.
+        // Matches of this block reach no farther than its window, neither do those of the blocks after it
+        history_window_log_ = window_log;
+        append_history({ }, continue_history);
+        const uint64_t start = window_.size();
+        const uint64_t history = history_bytes_;
+        uint64_t literal = 0;
+        for (uint64_t t = 0; t < tokens_.size(); t++)
+        {
+            const uint8_t token = tokens_[t];
+            uint64_t run = token >> 4;
+            if (run == 15) run += read_gamma(extra);
+            if (run > literals_.size() - literal || window_.size() - start + run > MaxBlockSize) {
+                throw std::invalid_argument("Corrupted block (LZ77 literals overrun)");
+            }
+
+            window_.insert(window_.end(), literals_.begin() + static_cast<int64_t>(literal), literals_.begin() + static_cast<int64_t>(literal + run));
+            literal += run;
+            if (t + 1 == tokens_.size()) break;
+
+            uint64_t length = token & 15;
+            if (length == 15) length += read_gamma(extra);
+            length += MinMatch;
+
+            const uint64_t reach = std::min<uint64_t>(1ULL << window_log, history + window_.size() - start);
+            const uint64_t distance = reach == 0 ? 0 : extra.read(std::bit_width(reach - 1)) + 1;
+            if (distance == 0 || distance > reach || distance > window_.size() || window_.size() - start + length > MaxBlockSize) {
+                throw std::invalid_argument("Corrupted block (LZ77 match out of reach)");
+            }
+
+            // overlapping matches repeat their own output, byte by byte
+            const uint64_t to = window_.size();
+            window_.resize(to + length);
+            uint8_t * out = window_.data() + to;
+            const uint8_t * from = out - distance;
+            if (distance >= length) {
+                std::memcpy(out, from, length);
+            } else {
+                for (uint64_t k = 0; k < length; k++) out[k] = from[k];
+            }
+        }
+
+        if (literal != literals_.size()) throw std::invalid_argument("Corrupted block (unused LZ77 literals)");
+
+        dst.assign(window_.begin() + static_cast<int64_t>(start), window_.end());
+        history_bytes_ += dst.size();
+    }
+}
@@ -0,0 +1,346 @@
+#include "pipeline.h"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace lzw
+{
+    /// Run produce(worker, block, output) for every block on the pool and hand each output to
+    /// consume(block, output) on the calling thread, in block order. Blocks run in windows;
+    /// the next window is already running while the previous one is consumed
+    template < typename Produce, typename Consume >
+    static void run_ordered(work_stealing_pool & pool, const uint64_t blocks, const uint64_t window_blocks,
+        stats::thread_stats_t * main_stats, Produce && produce, Consume && consume)
+    {
+        if (blocks == 0) return;
+
+        std::array < std::vector < std::vector<uint8_t> >, 2 > windows;
+        for (auto & window : windows) window.resize(std::min(window_blocks, blocks));
+
+        auto submit = [&](const uint64_t base)
+        {
+            auto & window = windows[(base / window_blocks) & 1];
+            pool.submit(base, std::min(blocks, base + window_blocks),
+                [&produce, &window, base](const uint64_t worker, const uint64_t block) { produce(worker, block, window[block - base]); });
+        };
+
+        try
+        {
+            submit(0);
+            for (uint64_t base = 0; base < blocks; base += window_blocks)
+            {
+                const auto start = stats::clock::now();
+                pool.wait();
+                if (main_stats) main_stats->wait(start, stats::clock::now());
+
+                if (base + window_blocks < blocks) {
+                    submit(base + window_blocks);
+                }
+
+                const auto & window = windows[(base / window_blocks) & 1];
+                for (uint64_t block = base; block < std::min(blocks, base + window_blocks); block++) {
+                    consume(block, window[block - base]);
+                }
+            }
+        }
+        catch (...)
+        {
+            // the windows must outlive every running task
+            pool.cancel();
+            try { pool.wait(); } catch (...) { }
+            throw;
+        }
+    }
+
+    /// Windows hold about 1 MiB of blocks per worker
+    static uint64_t window_blocks(const work_stealing_pool & pool, const uint64_t bytes_per_block)
+    {
+        return pool.size() * std::clamp<uint64_t>(1024 * 1024 / std::max<uint64_t>(bytes_per_block, 1), 16, 1024);
+    }
+
+    /// Fault in every page of a mapped block so page-in cost is accounted to the read stage
+    static void touch_pages(const std::span<const uint8_t> block)
+    {
+        constexpr uint64_t page_size = 4096;
+        uint8_t sink = 0;
+        for (uint64_t offset = 0; offset < block.size(); offset += page_size) {
+            sink ^= *reinterpret_cast<const volatile uint8_t *>(block.data() + offset);
+        }
+        (void)sink;
+    }
+
+    /// Whether a block of index continues an LZ77 history, only then must the blocks before it be kept for LZ77
+    static bool continues_lz77(const std::span<const uint8_t> container, const std::span<const block_ref_t> index)
+    {
+        return std::any_of(index.begin(), index.end(), [&](const block_ref_t & block) {
+            return block.size != 0 && container[block.offset] == block_codec::LZ77ContinuedSignature;
+        });
+    }
+
+    static void check_block_size(const uint64_t block_size)
+    {
+        if (block_size == 0 || block_size > block_codec::max_block_size) {
+            throw std::invalid_argument("Block size must be between 1 and " + std::to_string(block_codec::max_block_size));
+        }
+    }
+
+    compression_level_t compression_level(const uint64_t level)
+    {
+        using enum selection_t;
+        static constexpr compression_level_t levels[] = {
+            { Exhaustive, lz77_mode_t::Off,    16, reset_policy_t::Immediate, block_codec::block_size, 1 },
+            { Guided,     lz77_mode_t::Fast,   14, reset_policy_t::Immediate, 16383, 4 },
+            { Guided,     lz77_mode_t::Fast,   16, reset_policy_t::Immediate, 16383, 8 },
+            { Guided,     lz77_mode_t::Greedy, 16, reset_policy_t::Immediate, 16383, 8 },
+            { Guided,     lz77_mode_t::Greedy, 18, reset_policy_t::Immediate, 32767, 16 },
+            { Guided,     lz77_mode_t::Lazy,   18, reset_policy_t::Immediate, 32767, 16 },
+            { Guided,     lz77_mode_t::Lazy,   20, reset_policy_t::Immediate, 32767, 32 },
+            { Exhaustive, lz77_mode_t::Lazy,   20, reset_policy_t::Monitor,   32767, 32 },
+            { Exhaustive, lz77_mode_t::Lazy,   22, reset_policy_t::Monitor,   block_codec::max_block_size, 64 },
+            { Exhaustive, lz77_mode_t::Lazy,   22, reset_policy_t::Monitor,   block_codec::max_block_size, 256 },
+        };
+
+        if (level > max_compression_level) {
+            throw std::invalid_argument("Compression level must be between 1 and " + std::to_string(max_compression_level));
+        }
+
+        return levels[level];
+    }
+
+    block_pipeline::block_pipeline(work_stealing_pool & pool, stats::collector * stats) : pool_(pool), stats_(stats)
+    {
+        // contexts are built on their own worker, so with pinning their tables are first touched on its node
+        contexts_.resize(pool_.size());
+        pool_.for_each_worker([&](const uint64_t worker)
+        {
+            contexts_[worker] = std::make_unique<worker_context_t>();
+            contexts_[worker]->codec.set_stats(worker_stats(worker));
+        });
+
+        for (uint64_t worker = 0; worker < pool_.size(); worker++) {
+            pool_.set_stats(worker, worker_stats(worker));
+        }
+    }
+
+    static void check_group_blocks(const uint64_t group_blocks)
+    {
+        if (group_blocks == 0) {
+            throw std::invalid_argument("Group size must be at least 1 block");
+        }
+    }
+
+    static void append_section(const std::vector<uint8_t> & section, std::vector<uint8_t> & output)
+    {
+        if (section.size() > 0xFFFF) {
+            throw std::runtime_error("Compression failed for this data set");
+        }
+
+        const section_head_16bit_t section_head { .section_size = static_cast<uint16_t>(section.size()) };
+        const auto * head = reinterpret_cast<const uint8_t *>(&section_head);
+        output.insert(output.end(), head, head + sizeof(section_head));
+        output.insert(output.end(), section.begin(), section.end());
+    }
+
+    void block_pipeline::use_dictionary(const uint64_t worker, const dictionary_t * dictionary)
+    {
+        auto & context = *contexts_[worker];
+        if (context.dictionary != dictionary) {
+            context.codec.set_dictionary(dictionary);
+            context.dictionary = dictionary;
+        }
+    }
+
+    void block_pipeline::write_stream_header(std::vector<uint8_t> & output) const
+    {
+        if (!dictionary_ && level_ == 0) return;
+
+        stream_header_t header { };
+        std::memcpy(header.magic, stream_header_t::Magic, sizeof(header.magic));
+        header.version = stream_header_t::Version;
+        if (dictionary_)
+        {
+            header.dictionary_id = dictionary_->id;
+            header.flags = stream_header_t::HasDictionary;
+        }
+
+        header.level = static_cast<uint8_t>(level_);
+        const auto * bytes = reinterpret_cast<const uint8_t *>(&header);
+        output.insert(output.end(), bytes, bytes + sizeof(header));
+    }
+
+    const dictionary_t * block_pipeline::stream_dictionary(std::span<const uint8_t> & container) const
+    {
+        stream_header_t header { };
+        const auto header_size = read_stream_header(container, header);
+        if (header_size == 0) return nullptr;
+
+        container = container.subspan(header_size);
+        if (!(header.flags & stream_header_t::HasDictionary)) return nullptr;
+
+        if (!dictionary_ || dictionary_->id != header.dictionary_id)
+        {
+            char id[9];
+            std::snprintf(id, sizeof(id), "%08x", header.dictionary_id);
+            throw std::runtime_error(std::string("Stream needs dictionary ") + id);
+        }
+
+        return dictionary_;
+    }
+
+    void block_pipeline::compress_group(const uint64_t worker, const std::span<const uint8_t> data, const uint64_t block_size,
+        const uint64_t first, const uint64_t last, std::vector<uint8_t> & output)
+    {
+        use_dictionary(worker, dictionary_);
+        auto & context = *contexts_[worker];
+        context.codec.set_reset_policy(reset_policy_);
+        context.codec.set_growth(growth_);
+        context.codec.set_lz77(lz77_mode_, lz77_window_log_);
+        context.codec.set_selection(selection_);
+        context.codec.begin_group();
+        for (uint64_t block = first; block < last; block++)
+        {
+            const auto input = data.subspan(block * block_size, std::min(block_size, data.size() - block * block_size));
+            const char signature = context.codec.compress(input, context.block, true);
+            if (signature == block_codec::HuffmanSignature) {
+                ++huffman_blocks_;
+            } else if (signature == block_codec::LZ77Signature || signature == block_codec::LZ77ContinuedSignature) {
+                ++lz77_blocks_;
+            } else if (signature == block_codec::StoredSignature) {
+                ++stored_blocks_;
+            } else {
+                ++lzw_blocks_;
+            }
+
+            append_section(context.block, output);
+        }
+    }
+
+    void block_pipeline::decompress_group(const uint64_t worker, const std::span<const uint8_t> container,
+        const std::span<const block_ref_t> index, const dictionary_t * dictionary, std::vector<uint8_t> & output)
+    {
+        use_dictionary(worker, dictionary);
+        auto & context = *contexts_[worker];
+        context.codec.begin_group();
+        context.codec.set_lz77_history(continues_lz77(container, index));
+        output.clear();
+        for (const auto & [offset, size] : index)
+        {
+            if (output.empty()) {
+                context.codec.decompress(container.subspan(offset, size), output);
+            } else {
+                context.codec.decompress(container.subspan(offset, size), context.block);
+                output.insert(output.end(), context.block.begin(), context.block.end());
+            }
+        }
+    }
+
+    uint64_t block_pipeline::compress(const std::span<const uint8_t> data, const uint64_t block_size, std::ostream & output,
+        const uint64_t group_blocks)
+    {
+        check_block_size(block_size);
+        check_group_blocks(group_blocks);
+        auto * thread_stats = main_stats();
+        std::vector<uint8_t> header;
+        write_stream_header(header);
+        output.write(reinterpret_cast<const char *>(header.data()), static_cast<std::streamsize>(header.size()));
+        uint64_t written = header.size();
+
+        const auto blocks = data.size() / block_size + (data.size() % block_size != 0);
+        const auto groups = blocks / group_blocks + (blocks % group_blocks != 0);
+        run_ordered(pool_, groups, window_blocks(pool_, block_size * group_blocks), thread_stats,
+            [&](const uint64_t worker, const uint64_t group, std::vector<uint8_t> & sections)
+            {
+                const auto first = group * group_blocks;
+                const auto last = std::min(blocks, first + group_blocks);
+                if (auto * read_stats = worker_stats(worker))
+                {
+                    const auto input = data.subspan(first * block_size, std::min((last - first) * block_size, data.size() - first * block_size));
+                    const auto start = stats::clock::now();
+                    touch_pages(input);
+                    read_stats->record(stats::Read, start, stats::clock::now(), input.size(), input.size());
+                }
+
+                sections.clear();
+                compress_group(worker, data, block_size, first, last, sections);
+            },
+            [&](uint64_t, const std::vector<uint8_t> & sections)
+            {
+                stats::stopwatch watch(thread_stats);
+                output.write(reinterpret_cast<const char *>(sections.data()), static_cast<std::streamsize>(sections.size()));
+                written += sections.size();
+                watch.lap(stats::Write, sections.size(), sections.size());
+            });
+
+        return written;
+    }
+
+    uint64_t block_pipeline::decompress(std::span<const uint8_t> container, std::ostream & output)
+    {
+        // Every block boundary is known up front, so decoding never waits for the main thread.
+        // A group runs from a block that starts one up to the next, each group is one task
+        auto * thread_stats = main_stats();
+        const auto * dictionary = stream_dictionary(container);
+        {
+            stats::stopwatch watch(thread_stats);
+            index_blocks(container, index_);
+            groups_.clear();
+            for (uint64_t block = 0; block < index_.size(); block++)
+            {
+                if (block == 0 || block_codec::starts_group(container.subspan(index_[block].offset, index_[block].size))) {
+                    groups_.push_back(block);
+                }
+            }
+
+            groups_.push_back(index_.size());
+            watch.lap(stats::Read, container.size(), index_.size() * sizeof(block_ref_t));
+        }
+
+        uint64_t written = 0;
+        const uint64_t groups = groups_.size() - 1;
+        const uint64_t average_group = groups == 0 ? 1 : container.size() / groups;
+        run_ordered(pool_, groups, window_blocks(pool_, average_group), thread_stats,
+            [&](const uint64_t worker, const uint64_t group, std::vector<uint8_t> & decoded)
+            {
+                decompress_group(worker, container,
+                    std::span(index_).subspan(groups_[group], groups_[group + 1] - groups_[group]), dictionary, decoded);
+            },
+            [&](uint64_t, const std::vector<uint8_t> & decoded)
+            {
+                stats::stopwatch watch(thread_stats);
+                output.write(reinterpret_cast<const char *>(decoded.data()), static_cast<std::streamsize>(decoded.size()));
+                written += decoded.size();
+                watch.lap(stats::Write, decoded.size(), decoded.size());
+            });
+
+        return written;
+    }
+
+    void block_pipeline::compress_on(const uint64_t worker, const std::span<const uint8_t> data, const uint64_t block_size,
+        std::vector<uint8_t> & output, const uint64_t group_blocks)
+    {
+        check_block_size(block_size);
+        check_group_blocks(group_blocks);
+        write_stream_header(output);
+        const auto blocks = data.size() / block_size + (data.size() % block_size != 0);
+        for (uint64_t first = 0; first < blocks; first += group_blocks) {
+            compress_group(worker, data, block_size, first, std::min(blocks, first + group_blocks), output);
+        }
+    }
+
+    void block_pipeline::decompress_on(const uint64_t worker, std::span<const uint8_t> container, std::vector<uint8_t> & output)
+    {
+        // continued blocks follow their predecessor on the same codec, every other block starts afresh by itself
+        use_dictionary(worker, stream_dictionary(container));
+        auto & context = *contexts_[worker];
+        index_blocks(container, context.index);
+        context.codec.begin_group();
+        context.codec.set_lz77_history(continues_lz77(container, context.index));
+        for (const auto & [offset, size] : context.index)
+        {
+            context.codec.decompress(container.subspan(offset, size), context.block);
+            output.insert(output.end(), context.block.begin(), context.block.end());
+        }
+    }
+}
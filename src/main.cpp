@@ -5,10 +5,20 @@
 #include "args.h"
 #define USE_TSL_HOPSCOTCH_MAP
 #include "lzw6.h"
+#include "block.h"
+#include "stats.h"
+#include "scheduler.h"
+#include "pipeline.h"
+#include "archive.h"
+#include "dictionary.h"
+#include "numa.h"
+#include "cpu_features.h"
 #include "mmap.h"
 #include <fstream>
 #include <thread>
+#include <filesystem>
 #include <cstring>
+#include <sys/mman.h>
 #include "cppcrc.h"
 
 namespace utils = lzw::utils;
@@ -17,16 +27,306 @@ utils::PreDefinedArgumentType::PreDefinedArgument MainArgument = {
     { .short_name = 'h', .long_name = "help",       .argument_required = false, .description = "Show help" },
     { .short_name = 'v', .long_name = "version",    .argument_required = false, .description = "Show version" },
     { .short_name = 'i', .long_name = "input",      .argument_required = true,  .description = "Input file" },
-    { .short_name = 'o', .long_name = "output",     .argument_required = true,  .description = "Output file" },
+    { .short_name = 'o', .long_name = "output",     .argument_required = true,  .description = "Output file, or output directory with --batch" },
+    { .short_name = 'b', .long_name = "batch",      .argument_required = true,  .description = "Process every file of a directory, or of a list file with one path per line" },
     { .short_name = 'd', .long_name = "decompress", .argument_required = false, .description = "Decompress instead of compress" },
     { .short_name = 'T', .long_name = "threads",    .argument_required = true,  .description = "Specify the number of worker threads" },
+    { .short_name = 'B', .long_name = "block-size", .argument_required = true,  .description = "Block size in bytes when compressing (default 4095, or the level's)" },
+    { .short_name = -1,  .long_name = "train",      .argument_required = false, .description = "Train a dictionary on the samples of -i or --batch and write it to -o" },
+    { .short_name = -1,  .long_name = "dictionary", .argument_required = true,  .description = "Compress with, or decompress streams needing, this trained dictionary" },
+    { .short_name = -1,  .long_name = "reset-policy", .argument_required = true, .description = "What LZW does with a full dictionary: immediate (default, or the level's), monitor or freeze" },
+    { .short_name = -1,  .long_name = "growth",     .argument_required = true,  .description = "LZW dictionary growth: classic (default), lzmw or lzap" },
+    { .short_name = '1', .long_name = "",           .argument_required = false, .description = "Level 1, fastest: Huffman or a run-finding LZ77 per block, picked from its entropy, may be larger than no level" },
+    { .short_name = '2', .long_name = "",           .argument_required = false, .description = "Level 2: as 1 with a 64 KiB window in groups of 8 blocks" },
+    { .short_name = '3', .long_name = "",           .argument_required = false, .description = "Level 3: Huffman or greedy LZ77 per block, picked from its entropy" },
+    { .short_name = '4', .long_name = "",           .argument_required = false, .description = "Level 4: as 3 on 32 KiB blocks with a 256 KiB window" },
+    { .short_name = '5', .long_name = "",           .argument_required = false, .description = "Level 5: Huffman or lazy LZ77 per block, picked from its entropy" },
+    { .short_name = '6', .long_name = "",           .argument_required = false, .description = "Level 6: as 5 with a 1 MiB window in groups of 32 blocks" },
+    { .short_name = '7', .long_name = "",           .argument_required = false, .description = "Level 7: LZW, Huffman and lazy LZ77 on every block, the smallest is kept" },
+    { .short_name = '8', .long_name = "",           .argument_required = false, .description = "Level 8: as 7 on the largest blocks with a 4 MiB window" },
+    { .short_name = '9', .long_name = "",           .argument_required = false, .description = "Level 9, smallest: as 8 in groups of 256 blocks" },
+    { .short_name = -1,  .long_name = "lz77",       .argument_required = true,  .description = "Also try LZ77 on every block: off (default, or the level's), fast, greedy or lazy" },
+    { .short_name = -1,  .long_name = "lz77-window", .argument_required = true, .description = "LZ77 window as a power of two, 10 to 22 (default 16, or the level's)" },
+    { .short_name = -1,  .long_name = "group",      .argument_required = true,  .description = "Blocks per group sharing one LZW dictionary when compressing (default 1, no sharing, or the level's)" },
+    { .short_name = -1,  .long_name = "affinity",   .argument_required = false, .description = "Pin worker threads to CPUs, spread evenly across NUMA nodes" },
+    { .short_name = -1,  .long_name = "numa",       .argument_required = false, .description = "Pin workers and interleave the input across NUMA nodes" },
+    { .short_name = -1,  .long_name = "archive",    .argument_required = false, .description = "Bundle every input into the archive -o, or with -d unpack the archive -i into the directory -o" },
+    { .short_name = -1,  .long_name = "member",     .argument_required = true,  .description = "With -d --archive, extract only this member" },
+    { .short_name = -1,  .long_name = "list",       .argument_required = false, .description = "List the members of the archive -i" },
+    { .short_name = -1,  .long_name = "stats",      .argument_required = false, .description = "Print per-stage, per-thread timing and counters as JSON to stdout" },
+    { .short_name = -1,  .long_name = "cpu-features", .argument_required = true, .description = "Only use kernels for these CPU features: none, native (default), or a list of sse4.2,pclmul,avx2,bmi2,avx512" },
 };
 
 
-struct section_head_16bit_t {
-    uint16_t section_size;
+/// One file of a batch
+struct batch_entry_t {
+    std::filesystem::path input;
+    std::filesystem::path output;
+    std::filesystem::path relative; ///< Input path below the batch source, used as archive member name
+    uint64_t size;
 };
 
+/// Expand a directory (recursively) or a list file (one path per line) into batch entries
+/// @param source Directory or list file
+/// @param output_directory Outputs mirror the input layout below this directory
+/// @param compress Append .lz to outputs if true, strip it otherwise
+static std::vector<batch_entry_t> collect_batch(const std::filesystem::path & source,
+    const std::filesystem::path & output_directory, const bool compress)
+{
+    auto output_for = [&](const std::filesystem::path & relative)
+    {
+        auto output = output_directory / relative;
+        if (compress) {
+            output += ".lz";
+        } else if (output.extension() == ".lz") {
+            output.replace_extension();
+        } else {
+            output += ".out";
+        }
+
+        return output;
+    };
+
+    std::vector<batch_entry_t> entries;
+    if (std::filesystem::is_directory(source))
+    {
+        for (const auto & entry : std::filesystem::recursive_directory_iterator(source))
+        {
+            if (!entry.is_regular_file()) continue;
+            const auto relative = entry.path().lexically_relative(source);
+            entries.push_back({ entry.path(), output_for(relative), relative, entry.file_size() });
+        }
+    }
+    else
+    {
+        std::ifstream list(source);
+        if (!list) {
+            throw std::runtime_error("Could not open file list " + source.string() + ": " + std::strerror(errno));
+        }
+
+        for (std::string line; std::getline(list, line);)
+        {
+            if (line.empty()) continue;
+            const std::filesystem::path input(line);
+            entries.push_back({ input, output_for(input.relative_path()), input.relative_path(), std::filesystem::file_size(input) });
+        }
+    }
+
+    return entries;
+}
+
+/// Read a whole file into data
+static void read_file(const std::filesystem::path & path, const uint64_t size, std::vector<uint8_t> & data)
+{
+    std::ifstream input_stream(path, std::ios::binary);
+    data.resize(size);
+    if (!input_stream || !input_stream.read(reinterpret_cast<char *>(data.data()), static_cast<std::streamsize>(data.size()))) {
+        throw std::runtime_error(std::string("Could not read file: ") + std::strerror(errno));
+    }
+}
+
+/// Write a whole file from data
+static void write_file(const std::filesystem::path & path, const std::span<const uint8_t> data)
+{
+    std::ofstream output_stream(path, std::ios::binary);
+    if (!output_stream.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()))) {
+        throw std::runtime_error("Could not write " + path.string());
+    }
+}
+
+/// Run every entry through the pipeline. Files too small to fill the pool are whole tasks of one job,
+/// larger files are split into blocks across all workers one after another
+static void run_batch(lzw::block_pipeline & pipeline, lzw::work_stealing_pool & pool, const std::vector<batch_entry_t> & entries,
+    const bool compress, const uint64_t block_size, const uint64_t group_blocks)
+{
+    for (const auto & entry : entries) {
+        std::filesystem::create_directories(entry.output.parent_path());
+    }
+
+    const uint64_t large_file = pool.size() * 1024 * 1024;
+    std::vector < const batch_entry_t * > small, large;
+    for (const auto & entry : entries) {
+        (entry.size >= large_file ? large : small).push_back(&entry);
+    }
+
+    std::vector < std::vector<uint8_t> > inputs(pool.size()), outputs(pool.size());
+    pool.run(0, small.size(), [&](const uint64_t worker, const uint64_t task)
+    {
+        const auto & entry = *small[task];
+        try
+        {
+            auto & input = inputs[worker];
+            auto & output = outputs[worker];
+            read_file(entry.input, entry.size, input);
+            output.clear();
+            if (compress) {
+                pipeline.compress_on(worker, input, block_size, output, group_blocks);
+            } else {
+                pipeline.decompress_on(worker, input, output);
+            }
+
+            write_file(entry.output, output);
+        }
+        catch (const std::exception & e) {
+            throw std::runtime_error(entry.input.string() + ": " + e.what());
+        }
+    });
+
+    for (const auto * entry : large)
+    {
+        lzw::basic_io::mmap input_mmap(entry->input, true);
+        std::ofstream output_stream(entry->output, std::ios::binary);
+        if (!output_stream) {
+            throw std::runtime_error("Could not open file " + entry->output.string() + ": " + std::strerror(errno));
+        }
+
+        const std::span input(reinterpret_cast<const uint8_t *>(input_mmap.data()), input_mmap.size());
+        if (compress) {
+            pipeline.compress(input, block_size, output_stream, group_blocks);
+        } else {
+            pipeline.decompress(input, output_stream);
+        }
+    }
+}
+
+/// Bundle every entry into one archive, in entry order. Runs of small files are compressed as whole tasks
+/// and appended in order once the run is done, large files are split into blocks across all workers
+static void create_archive(lzw::block_pipeline & pipeline, lzw::work_stealing_pool & pool,
+    const std::vector<batch_entry_t> & entries, const std::string & archive_file, const uint64_t block_size,
+    const uint64_t group_blocks)
+{
+    std::ofstream archive_stream(archive_file, std::ios::binary);
+    if (!archive_stream) {
+        throw std::runtime_error("Could not open file " + archive_file + ": " + std::strerror(errno));
+    }
+
+    lzw::archive::writer writer(archive_stream, block_size, group_blocks);
+    const uint64_t large_file = pool.size() * 1024 * 1024;
+    const uint64_t run_size = pool.size() * 16;
+    std::vector < std::vector<uint8_t> > inputs(pool.size()), containers(run_size);
+    std::vector < uint32_t > checksums(run_size);
+    for (uint64_t first = 0; first < entries.size();)
+    {
+        const auto & head = entries[first];
+        if (head.size >= large_file)
+        {
+            lzw::basic_io::mmap input_mmap(head.input, true);
+            writer.add(pipeline, head.relative.generic_string(),
+                { reinterpret_cast<const uint8_t *>(input_mmap.data()), input_mmap.size() });
+            first++;
+            continue;
+        }
+
+        uint64_t last = first;
+        while (last < entries.size() && last - first < run_size && entries[last].size < large_file) last++;
+        pool.run(first, last, [&](const uint64_t worker, const uint64_t task)
+        {
+            const auto & entry = entries[task];
+            try
+            {
+                auto & input = inputs[worker];
+                auto & container = containers[task - first];
+                read_file(entry.input, entry.size, input);
+                checksums[task - first] = lzw::archive::checksum(input);
+                container.clear();
+                pipeline.compress_on(worker, input, block_size, container, group_blocks);
+            }
+            catch (const std::exception & e) {
+                throw std::runtime_error(entry.input.string() + ": " + e.what());
+            }
+        });
+
+        for (uint64_t task = first; task < last; task++) {
+            writer.add_container(entries[task].relative.generic_string(), entries[task].size,
+                checksums[task - first], containers[task - first]);
+        }
+
+        first = last;
+    }
+
+    writer.finish();
+}
+
+/// Where a member lands below the output directory
+/// @throws std::runtime_error Member name escapes the output directory
+static std::filesystem::path member_output(const std::filesystem::path & output_directory, const std::string & name)
+{
+    const auto relative = std::filesystem::path(name).lexically_normal();
+    if (name.empty() || relative.is_absolute() || (!relative.empty() && *relative.begin() == "..")) {
+        throw std::runtime_error("Refusing to extract member outside the output directory: " + name);
+    }
+
+    return output_directory / relative;
+}
+
+/// Unpack one member, or every member, of an archive into a directory.
+/// Small members are whole tasks, large ones are decoded across all workers
+static void extract_archive(lzw::block_pipeline & pipeline, lzw::work_stealing_pool & pool,
+    const std::string & archive_file, const std::filesystem::path & output_directory, const std::string * member_name)
+{
+    lzw::basic_io::mmap archive_mmap(archive_file, true);
+    const lzw::archive::reader reader({ reinterpret_cast<const uint8_t *>(archive_mmap.data()), archive_mmap.size() });
+
+    std::vector < const lzw::archive::member_t * > members;
+    if (member_name)
+    {
+        const auto * member = reader.find(*member_name);
+        if (!member) {
+            throw std::runtime_error("No member named " + *member_name + " in " + archive_file);
+        }
+
+        members.push_back(member);
+    }
+    else
+    {
+        for (const auto & member : reader.members()) members.push_back(&member);
+    }
+
+    for (const auto * member : members) {
+        std::filesystem::create_directories(member_output(output_directory, member->name).parent_path());
+    }
+
+    const uint64_t large_file = pool.size() * 1024 * 1024;
+    std::vector < const lzw::archive::member_t * > small, large;
+    for (const auto * member : members) {
+        (member->original_size >= large_file ? large : small).push_back(member);
+    }
+
+    std::vector < std::vector<uint8_t> > outputs(pool.size());
+    pool.run(0, small.size(), [&](const uint64_t worker, const uint64_t task)
+    {
+        reader.extract_on(pipeline, worker, *small[task], outputs[worker]);
+        write_file(member_output(output_directory, small[task]->name), outputs[worker]);
+    });
+
+    for (const auto * member : large)
+    {
+        const auto path = member_output(output_directory, member->name);
+        std::ofstream output_stream(path, std::ios::binary);
+        if (!output_stream) {
+            throw std::runtime_error("Could not open file " + path.string() + ": " + std::strerror(errno));
+        }
+
+        reader.extract(pipeline, *member, output_stream);
+    }
+}
+
+/// Train a dictionary on every entry, each file being one sample
+static void train(const std::vector<batch_entry_t> & entries, const std::string & dictionary_file, const uint64_t block_size)
+{
+    std::vector < std::vector<uint8_t> > contents(entries.size());
+    std::vector < std::span<const uint8_t> > samples;
+    for (uint64_t i = 0; i < entries.size(); i++) {
+        read_file(entries[i].input, entries[i].size, contents[i]);
+        samples.emplace_back(contents[i]);
+    }
+
+    // a quarter of the 12-bit dictionary: more phrases widen every code of a small block
+    const auto dictionary = lzw::train_dictionary(samples, block_size, 1024);
+    lzw::save_dictionary(dictionary, dictionary_file);
+    fprintf(stderr, "Dictionary %08x: %lu phrases from %lu samples\n", dictionary.id, dictionary.lzw_prefix.size(), samples.size());
+}
+
 int main(int argc, char** argv)
 {
     try
@@ -40,28 +340,51 @@ int main(int argc, char** argv)
             return EXIT_SUCCESS;
         }
 
+        if (parsed.contains("cpu-features")) {
+            lzw::cpu::restrict_to(parsed.at("cpu-features"));
+        }
+
         if (parsed.contains("version")) {
-            std::cout << *argv << VERSION << ", DEBUG=" << DEBUG << std::endl;
+            std::cout << *argv << VERSION << ", DEBUG=" << DEBUG << ", CPU=" << lzw::cpu::describe(lzw::cpu::active()) << std::endl;
             return EXIT_SUCCESS;
         }
 
-        if (!parsed.contains("input") || !parsed.contains("output")) {
+        if (parsed.contains("list"))
+        {
+            if (!parsed.contains("input")) {
+                throw std::invalid_argument("--list needs an archive given by -i");
+            }
+
+            lzw::basic_io::mmap archive_mmap(parsed.at("input"), true);
+            const lzw::archive::reader reader({ reinterpret_cast<const uint8_t *>(archive_mmap.data()), archive_mmap.size() });
+            for (const auto & member : reader.members()) {
+                printf("%12lu %12lu %08x %s\n", member.original_size, member.compressed_size, member.crc, member.name.c_str());
+            }
+
+            return EXIT_SUCCESS;
+        }
+
+        if ((!parsed.contains("input") && !parsed.contains("batch")) || !parsed.contains("output")) {
             std::cout << *argv << " [Arguments [OPTIONS...]...]" << std::endl;
             std::cout << PreDefinedArguments.print_help();
             return EXIT_FAILURE;
         }
 
-        const auto input_file = parsed.at("input");
-        const auto output_file = parsed.at("output");
+        // a level sets the defaults, options given on their own still override them
+        uint64_t level = 0;
+        for (uint64_t candidate = 1; candidate <= lzw::max_compression_level; candidate++)
+        {
+            if (!parsed.contains(static_cast<signed char>('0' + candidate))) continue;
+            if (level != 0) {
+                throw std::invalid_argument("Only one compression level may be given");
+            }
 
-        lzw::basic_io::mmap input_mmap(input_file, true);
-        std::ofstream output_stream(output_file);
-        if (!output_stream) {
-            throw std::runtime_error("Could not open file " + output_file + ": " + std::strerror(errno));
+            level = candidate;
         }
 
-        constexpr uint64_t bit_size = 12;
-        constexpr uint64_t block_size = lzw::const_two_power(bit_size) - 1;
+        const auto preset = lzw::compression_level(level);
+        const auto output_file = parsed.at("output");
+        uint64_t block_size = preset.block_size;
         bool compress = !parsed.contains("decompress");
         unsigned int workers = std::thread::hardware_concurrency();
         if (parsed.contains("threads")) {
@@ -72,149 +395,195 @@ int main(int argc, char** argv)
             }
         }
 
-        if (compress)
+        if (workers == 0) {
+            workers = 1;
+        }
+
+        if (parsed.contains("block-size")) {
+            block_size = std::strtoull(parsed.at("block-size").c_str(), nullptr, 10);
+            if (block_size == 0 || block_size > lzw::block_codec::max_block_size) {
+                throw std::invalid_argument("Block size must be between 1 and " + std::to_string(lzw::block_codec::max_block_size));
+            }
+        }
+
+        uint64_t group_blocks = preset.group_blocks;
+        if (parsed.contains("group")) {
+            group_blocks = std::strtoull(parsed.at("group").c_str(), nullptr, 10);
+            if (group_blocks == 0) {
+                throw std::invalid_argument("Group size must be at least 1 block");
+            }
+        }
+
+        auto reset_policy = preset.reset_policy;
+        if (parsed.contains("reset-policy"))
         {
-            std::atomic < uint64_t > lzw_used(0);
-            std::atomic < uint64_t > huffman_used(0);
-            const auto blocks = input_mmap.size() / block_size + (input_mmap.size() % block_size != 0);
-            struct pool_frame_t {
-                std::vector<uint8_t> output;
-                section_head_16bit_t section_head { };
-                uint64_t index { };
-            };
-
-            std::vector < std::pair < std::thread, std::unique_ptr < pool_frame_t > > > thread_pool;
-            int active_threads = 0;
-
-            auto sync_thread = [&] {
-                std::ranges::for_each(thread_pool, [&](std::pair < std::thread, std::unique_ptr < pool_frame_t > > & T) {
-                    if (T.first.joinable()) T.first.join();
-                    const auto & frame = *T.second;
-                    output_stream.write(reinterpret_cast<const char *>(&frame.section_head), sizeof(frame.section_head));
-                    output_stream.write(reinterpret_cast<const char *>(frame.output.data()), static_cast<std::streamsize>(frame.output.size()));
-                });
-
-                thread_pool.clear();
-            };
-
-            for (uint64_t i = 0; i < blocks; i++)
-            {
-                auto frame_ = std::make_unique<pool_frame_t>();
-                frame_->index = i;
-
-                thread_pool.emplace_back(std::thread([&](pool_frame_t * frame)
-                {
-                    std::vector<uint8_t> input(input_mmap.data() + block_size * frame->index,
-                        input_mmap.data() + std::min(static_cast<uint64_t>(input_mmap.size()), block_size * (frame->index + 1)));
-                    {
-                        std::vector<uint8_t> output_huffman;
-                        std::vector<uint8_t> output_lzw;
-                        lzw::lzw<bit_size> Compressor(input, output_lzw);
-                        lzw::Huffman huffman(input, output_huffman);
-                        Compressor.compress();
-                        huffman.compress();
-
-                        auto write_buffer = [&](const std::vector<uint8_t> & buffer, const char signature)
-                        {
-                            frame->output.clear();
-                            frame->output.reserve(output_lzw.size() + 1);
-                            frame->output.push_back(signature);
-                            frame->output.insert(frame->output.end(), buffer.begin(), buffer.end());
-                        };
-
-                        if (output_huffman.size() > output_lzw.size()) {
-                            ++lzw_used;
-                            write_buffer(output_lzw, 'L');
-                        } else {
-                            ++huffman_used;
-                            write_buffer(output_huffman, 'H');
-                        }
-                    }
-
-                    if (frame->output.size() > 0xFFFF) {
-                        throw std::runtime_error("Compression failed for this data set");
-                    }
-                    frame->section_head.section_size = static_cast<uint16_t>(frame->output.size());
-                }, frame_.get()), std::move(frame_));
-
-                active_threads++;
-
-                if (active_threads >= workers) {
-                    sync_thread();
-                    active_threads = 0;
-                }
+            const auto policy = parsed.at("reset-policy");
+            if (policy == "immediate") {
+                reset_policy = lzw::reset_policy_t::Immediate;
+            } else if (policy == "monitor") {
+                reset_policy = lzw::reset_policy_t::Monitor;
+            } else if (policy == "freeze") {
+                reset_policy = lzw::reset_policy_t::Freeze;
+            } else {
+                throw std::invalid_argument("Unknown reset policy " + policy + ", expected immediate, monitor or freeze");
+            }
+        }
+
+        auto growth = lzw::growth_t::Classic;
+        if (parsed.contains("growth"))
+        {
+            const auto name = parsed.at("growth");
+            if (name == "lzmw") {
+                growth = lzw::growth_t::LZMW;
+            } else if (name == "lzap") {
+                growth = lzw::growth_t::LZAP;
+            } else if (name != "classic") {
+                throw std::invalid_argument("Unknown growth " + name + ", expected classic, lzmw or lzap");
             }
+        }
 
-            sync_thread();
-            const double lzw_perc = lzw_used / static_cast<double>(lzw_used + huffman_used);
-            fprintf(stderr, "LZW: %lu (%0.2f%%), Huffman: %lu (%0.2f%%), overall %lu * %lu\n",
-                lzw_used.load(), lzw_perc * 100, huffman_used.load(), (1 - lzw_perc)*100, lzw_used + huffman_used, block_size);
+        auto lz77_mode = preset.lz77_mode;
+        if (parsed.contains("lz77"))
+        {
+            const auto name = parsed.at("lz77");
+            if (name == "off") {
+                lz77_mode = lzw::lz77_mode_t::Off;
+            } else if (name == "fast") {
+                lz77_mode = lzw::lz77_mode_t::Fast;
+            } else if (name == "greedy") {
+                lz77_mode = lzw::lz77_mode_t::Greedy;
+            } else if (name == "lazy") {
+                lz77_mode = lzw::lz77_mode_t::Lazy;
+            } else {
+                throw std::invalid_argument("Unknown LZ77 mode " + name + ", expected off, fast, greedy or lazy");
+            }
         }
-        else
+
+        uint64_t lz77_window_log = preset.lz77_window_log;
+        if (parsed.contains("lz77-window"))
         {
-            struct pool_frame_t {
-                std::vector<uint8_t> output;
-                char * begin = nullptr;
-                char * end = nullptr;
-            };
+            lz77_window_log = std::strtoull(parsed.at("lz77-window").c_str(), nullptr, 10);
+            if (lz77_window_log < lzw::lz77::MinWindowLog || lz77_window_log > lzw::lz77::MaxWindowLog) {
+                throw std::invalid_argument("LZ77 window must be between " + std::to_string(lzw::lz77::MinWindowLog)
+                    + " and " + std::to_string(lzw::lz77::MaxWindowLog));
+            }
+        }
 
-            std::vector < std::pair < std::thread, std::unique_ptr < pool_frame_t > > > thread_pool;
-            int active_threads = 0;
+        std::unique_ptr < lzw::stats::collector > stats;
+        if (parsed.contains("stats")) {
+            stats = std::make_unique<lzw::stats::collector>(workers);
+        }
 
-            auto sync_thread = [&] {
-                std::ranges::for_each(thread_pool, [&](std::pair < std::thread, std::unique_ptr < pool_frame_t > > & T) {
-                    if (T.first.joinable()) T.first.join();
-                    const auto & output = T.second->output;
-                    output_stream.write(reinterpret_cast<const char *>(output.data()), static_cast<std::streamsize>(output.size()));
-                });
+        lzw::work_stealing_pool pool(workers);
+        const bool numa = parsed.contains("numa");
+        if (numa || parsed.contains("affinity"))
+        {
+            const auto cpus = lzw::numa::cpu_order();
+            if (!cpus.empty()) {
+                pool.for_each_worker([&](const uint64_t worker) { lzw::numa::pin_current_thread(cpus[worker % cpus.size()]); });
+            }
+        }
 
-                thread_pool.clear();
-            };
+        if (parsed.contains("train"))
+        {
+            std::vector<batch_entry_t> entries;
+            if (parsed.contains("batch")) {
+                entries = collect_batch(parsed.at("batch"), { }, true);
+            } else {
+                const std::filesystem::path input(parsed.at("input"));
+                entries.push_back({ input, { }, input.filename(), std::filesystem::file_size(input) });
+            }
 
-            uint64_t offset = 0;
-            auto read_head = [&]()->section_head_16bit_t
-            {
-                section_head_16bit_t ret { };
-                std::memcpy(&ret, input_mmap.data() + offset, sizeof(ret));
-                offset += sizeof(ret);
-                return ret;
-            };
+            train(entries, output_file, block_size);
+            return EXIT_SUCCESS;
+        }
 
-            for (uint64_t i = 0; offset < input_mmap.size(); i++)
+        lzw::dictionary_t dictionary;
+        lzw::block_pipeline pipeline(pool, stats.get());
+        pipeline.set_reset_policy(reset_policy);
+        pipeline.set_growth(growth);
+        pipeline.set_lz77(lz77_mode, lz77_window_log);
+        pipeline.set_selection(preset.selection);
+        pipeline.set_level(level);
+        if (parsed.contains("dictionary")) {
+            dictionary = lzw::load_dictionary(parsed.at("dictionary"));
+            pipeline.set_dictionary(&dictionary);
+        }
+
+        if (parsed.contains("archive") && compress)
+        {
+            std::vector<batch_entry_t> entries;
+            if (parsed.contains("batch")) {
+                entries = collect_batch(parsed.at("batch"), { }, true);
+            } else {
+                const std::filesystem::path input(parsed.at("input"));
+                entries.push_back({ input, { }, input.filename(), std::filesystem::file_size(input) });
+            }
+
+            create_archive(pipeline, pool, entries, output_file, block_size, group_blocks);
+        }
+        else if (parsed.contains("archive"))
+        {
+            if (!parsed.contains("input")) {
+                throw std::invalid_argument("Unpacking an archive needs it given by -i");
+            }
+
+            const auto member = parsed.contains("member") ? parsed.at("member") : std::string();
+            extract_archive(pipeline, pool, parsed.at("input"), output_file, parsed.contains("member") ? &member : nullptr);
+        }
+        else if (parsed.contains("batch"))
+        {
+            const auto entries = collect_batch(parsed.at("batch"), output_file, compress);
+            run_batch(pipeline, pool, entries, compress, block_size, group_blocks);
+        }
+        else
+        {
+            const auto input_file = parsed.at("input");
+            lzw::basic_io::mmap input_mmap(input_file, true);
+            std::ofstream output_stream(output_file);
+            if (!output_stream) {
+                throw std::runtime_error("Could not open file " + output_file + ": " + std::strerror(errno));
+            }
+
+            // Spread the input over every node so no single memory controller serves all workers.
+            // Resident pages stay where they are, pages read ahead now follow the interleave policy
+            if (numa && input_mmap.size() != 0)
             {
-                auto frame_ = std::make_unique<pool_frame_t>();
-                const auto [section_size] = read_head();
-                frame_->begin = input_mmap.data() + offset;
-                frame_->end = input_mmap.data() + offset + section_size;
-                offset += section_size;
-
-                thread_pool.emplace_back(std::thread([](pool_frame_t * frame)
-                {
-                    std::vector<uint8_t> input(frame->begin, frame->end);
-                    if (!input.empty() && input.front() == 'H') { // Huffman
-                        input.erase(input.begin());
-                        lzw::Huffman huffman(input, frame->output);
-                        huffman.decompress();
-                    } else {
-                        input.erase(input.begin());
-                        lzw::lzw<bit_size> Compressor(input, frame->output);
-                        Compressor.decompress();
-                    }
-                }, frame_.get()), std::move(frame_));
-
-                active_threads++;
-
-                if (active_threads >= workers) {
-                    sync_thread();
-                    active_threads = 0;
+                lzw::numa::interleave(input_mmap.data(), input_mmap.size());
+                if (lzw::numa::interleave_current_thread(true)) {
+                    ::madvise(input_mmap.data(), input_mmap.size(), MADV_WILLNEED);
+                    lzw::numa::interleave_current_thread(false);
                 }
             }
 
-            sync_thread();
+            const std::span input(reinterpret_cast<const uint8_t *>(input_mmap.data()), input_mmap.size());
+            if (compress) {
+                pipeline.compress(input, block_size, output_stream, group_blocks);
+            } else {
+                pipeline.decompress(input, output_stream);
+            }
+
+            output_stream.close();
+            input_mmap.close();
         }
 
-        output_stream.close();
-        input_mmap.close();
+        if (compress)
+        {
+            const auto lzw_used = pipeline.lzw_blocks();
+            const auto huffman_used = pipeline.huffman_blocks();
+            const auto lz77_used = pipeline.lz77_blocks();
+            const auto stored = pipeline.stored_blocks();
+            const auto total = static_cast<double>(lzw_used + huffman_used + lz77_used + stored);
+            fprintf(stderr, "LZW: %lu (%0.2f%%), Huffman: %lu (%0.2f%%)", lzw_used, lzw_used / total * 100,
+                huffman_used, huffman_used / total * 100);
+            if (lz77_mode != lzw::lz77_mode_t::Off) fprintf(stderr, ", LZ77: %lu (%0.2f%%)", lz77_used, lz77_used / total * 100);
+            if (stored != 0) fprintf(stderr, ", stored: %lu (%0.2f%%)", stored, stored / total * 100);
+            fprintf(stderr, ", overall %lu * %lu\n", lzw_used + huffman_used + lz77_used + stored, block_size);
+        }
+
+        if (stats) {
+            stats->to_json(std::cout, compress ? "compress" : "decompress");
+        }
 
         return EXIT_SUCCESS;
     }
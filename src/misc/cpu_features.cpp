@@ -0,0 +1,216 @@
+#include "cpu_features.h"
+#include <algorithm>
+#include <stdexcept>
+#include "cppcrc.h"
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+# define LZW_X86_KERNELS 1      // kernels compiled again per instruction set, picked at runtime
+# include <immintrin.h>
+#else
+# define LZW_X86_KERNELS 0
+#endif
+
+namespace lzw::cpu
+{
+    static constexpr std::string_view feature_names[] = { "sse4.2", "pclmul", "avx2", "bmi2", "avx512" };
+
+    /// Feature flags in feature_names order
+    static bool * feature_flag(features_t & features, const uint64_t index)
+    {
+        bool * flags[] = { &features.sse42, &features.pclmul, &features.avx2, &features.bmi2, &features.avx512 };
+        return flags[index];
+    }
+
+    /// Only a generic histogram: the kernel is bound by its counter stores, an AVX2 build of it measured the same
+    static void histogram_generic(const std::span<const uint8_t> data, histogram_t & histogram)
+    {
+        accumulate_histogram(data, histogram);
+    }
+
+    static uint32_t crc32_generic(const std::span<const uint8_t> data, const uint32_t prior)
+    {
+        return CRC32::CRC32::calc(data.data(), data.size(), prior);
+    }
+
+    static void pack_codes_generic(const std::span<const uint8_t> src, const uint64_t * table, const uint64_t longest,
+        code_packer_t & packer)
+    {
+        pack_codes(src, table, longest, packer);
+    }
+
+#if LZW_X86_KERNELS
+    /// Same kernels with shlx/shrx for the variable shifts, which leave the flags alone and take one uop
+    [[gnu::target("bmi2")]] static void pack_codes_bmi2(const std::span<const uint8_t> src, const uint64_t * table,
+        const uint64_t longest, code_packer_t & packer)
+    {
+        pack_codes(src, table, longest, packer);
+    }
+
+    /// Carry-less multiply the two halves of lane by the two constants of k, and add in next
+    [[gnu::target("sse4.2,pclmul")]] static inline __m128i fold_lane(const __m128i lane, const __m128i k, const __m128i next)
+    {
+        const __m128i low = _mm_clmulepi64_si128(lane, k, 0x00);
+        const __m128i high = _mm_clmulepi64_si128(lane, k, 0x11);
+        return _mm_xor_si128(_mm_xor_si128(low, high), next);
+    }
+
+    [[gnu::target("sse4.2,pclmul")]] static inline __m128i load_lane(const uint8_t * data)
+    {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+    }
+
+    /// CRC32 of a multiple of 16 bytes, at least 64, by carry-less multiplication: four 128-bit lanes are
+    /// folded 64 bytes ahead, then into one lane, and Barrett reduced to 32 bits.
+    /// Constants are the bit-reflected x^n mod P(x) of Gopal et al., "Fast CRC Computation for Generic
+    /// Polynomials Using PCLMULQDQ Instruction". Works on the CRC register, which is the inverted CRC value
+    [[gnu::target("sse4.2,pclmul")]] static uint32_t crc32_fold(const uint8_t * data, uint64_t size, const uint32_t crc)
+    {
+        const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+        const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+        const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+        const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+        const __m128i low32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+        __m128i x1 = _mm_xor_si128(load_lane(data), _mm_cvtsi32_si128(static_cast<int>(crc)));
+        __m128i x2 = load_lane(data + 16), x3 = load_lane(data + 32), x4 = load_lane(data + 48);
+        data += 64;
+        size -= 64;
+
+        for (; size >= 64; data += 64, size -= 64)
+        {
+            x1 = fold_lane(x1, k1k2, load_lane(data));
+            x2 = fold_lane(x2, k1k2, load_lane(data + 16));
+            x3 = fold_lane(x3, k1k2, load_lane(data + 32));
+            x4 = fold_lane(x4, k1k2, load_lane(data + 48));
+        }
+
+        x1 = fold_lane(x1, k3k4, x2);
+        x1 = fold_lane(x1, k3k4, x3);
+        x1 = fold_lane(x1, k3k4, x4);
+        for (; size >= 16; data += 16, size -= 16) {
+            x1 = fold_lane(x1, k3k4, load_lane(data));
+        }
+
+        // 128 to 64 bits
+        x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), _mm_clmulepi64_si128(x1, k3k4, 0x10));
+        x1 = _mm_xor_si128(_mm_srli_si128(x1, 4), _mm_clmulepi64_si128(_mm_and_si128(x1, low32), k5k0, 0x00));
+
+        // Barrett reduction to 32 bits
+        __m128i quotient = _mm_clmulepi64_si128(_mm_and_si128(x1, low32), poly, 0x10);
+        quotient = _mm_clmulepi64_si128(_mm_and_si128(quotient, low32), poly, 0x00);
+        return static_cast<uint32_t>(_mm_extract_epi32(_mm_xor_si128(x1, quotient), 1));
+    }
+
+    static uint32_t crc32_pclmul(const std::span<const uint8_t> data, const uint32_t prior)
+    {
+        constexpr uint64_t MinFold = 64;
+        if (data.size() < MinFold) return crc32_generic(data, prior);
+
+        const uint64_t folded = data.size() & ~15ull;
+        const uint32_t crc = ~crc32_fold(data.data(), folded, ~prior);
+        return crc32_generic(data.subspan(folded), crc);
+    }
+#endif
+
+    const features_t & detected()
+    {
+        static const features_t features = []
+        {
+            features_t ret;
+#if LZW_X86_KERNELS
+            __builtin_cpu_init();
+            ret.sse42 = __builtin_cpu_supports("sse4.2");
+            ret.pclmul = __builtin_cpu_supports("pclmul");
+            ret.avx2 = __builtin_cpu_supports("avx2");
+            ret.bmi2 = __builtin_cpu_supports("bmi2");
+            ret.avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+            return ret;
+        }();
+
+        return features;
+    }
+
+    kernels_t kernels_for([[maybe_unused]] const features_t & features)
+    {
+        kernels_t ret {
+            .histogram = histogram_generic,
+            .crc32 = crc32_generic,
+            .pack_codes = pack_codes_generic,
+        };
+
+#if LZW_X86_KERNELS
+        if (features.sse42 && features.pclmul) ret.crc32 = crc32_pclmul;
+        if (features.bmi2) ret.pack_codes = pack_codes_bmi2;
+#endif
+        return ret;
+    }
+
+    /// Active features and the kernels bound for them
+    struct binding_t
+    {
+        features_t features;
+        kernels_t kernels;
+    };
+
+    static binding_t & binding()
+    {
+        static binding_t bound { .features = detected(), .kernels = kernels_for(detected()) };
+        return bound;
+    }
+
+    const features_t & active()
+    {
+        return binding().features;
+    }
+
+    const kernels_t & kernels()
+    {
+        return binding().kernels;
+    }
+
+    void restrict_to(const std::string_view list)
+    {
+        features_t features;
+        if (list == "native") {
+            features = detected();
+        }
+        else if (list != "none")
+        {
+            features_t available = detected();
+            for (uint64_t begin = 0; begin <= list.size();)
+            {
+                const uint64_t end = std::min(list.find(',', begin), list.size());
+                const auto name = list.substr(begin, end - begin);
+                begin = end + 1;
+
+                const auto found = std::ranges::find(feature_names, name);
+                if (found == std::end(feature_names)) {
+                    throw std::invalid_argument("Unknown CPU feature '" + std::string(name) + "'");
+                }
+
+                const auto index = static_cast<uint64_t>(found - std::begin(feature_names));
+                if (!*feature_flag(available, index)) {
+                    throw std::runtime_error("CPU feature " + std::string(name) + " is not available on this CPU");
+                }
+
+                *feature_flag(features, index) = true;
+            }
+        }
+
+        binding() = { .features = features, .kernels = kernels_for(features) };
+    }
+
+    std::string describe(const features_t & features)
+    {
+        features_t copy = features;
+        std::string ret;
+        for (uint64_t i = 0; i < std::size(feature_names); i++)
+        {
+            if (!*feature_flag(copy, i)) continue;
+            if (!ret.empty()) ret += ',';
+            ret += feature_names[i];
+        }
+
+        return ret.empty() ? "none" : ret;
+    }
+}
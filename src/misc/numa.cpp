@@ -0,0 +1,122 @@
+#include "numa.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace lzw::numa
+{
+    static constexpr int MPOL_DEFAULT_ = 0;
+    static constexpr int MPOL_INTERLEAVE_ = 3;
+
+    /// Parse a sysfs list such as "0-3,8,10-11"
+    static std::vector<int> parse_list(const std::string & path)
+    {
+        std::ifstream file(path);
+        std::string text;
+        std::vector<int> ret;
+        if (!file || !std::getline(file, text)) return ret;
+
+        std::stringstream list(text);
+        for (std::string range; std::getline(list, range, ',');)
+        {
+            if (range.empty()) continue;
+            const auto dash = range.find('-');
+            const int first = std::stoi(range.substr(0, dash));
+            const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int i = first; i <= last; i++) ret.push_back(i);
+        }
+
+        return ret;
+    }
+
+    /// Node mask with every online node set, as expected by mbind/set_mempolicy
+    static std::vector<unsigned long> node_mask(const std::vector<int> & nodes, unsigned long & max_node)
+    {
+        constexpr int bits = sizeof(unsigned long) * 8;
+        const int highest = nodes.empty() ? 0 : *std::ranges::max_element(nodes);
+        std::vector<unsigned long> mask(highest / bits + 1, 0);
+        for (const int node : nodes) mask[node / bits] |= 1ul << (node % bits);
+        max_node = mask.size() * bits;
+        return mask;
+    }
+
+    std::vector<int> online_nodes()
+    {
+        auto nodes = parse_list("/sys/devices/system/node/online");
+        if (nodes.empty()) nodes.push_back(0);
+        return nodes;
+    }
+
+    std::vector<int> cpu_order()
+    {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return { };
+
+        std::vector < std::vector<int> > per_node;
+        for (const int node : online_nodes())
+        {
+            auto cpus = parse_list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::erase_if(cpus, [&](const int cpu) { return cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed); });
+            if (!cpus.empty()) per_node.push_back(std::move(cpus));
+        }
+
+        if (per_node.empty())
+        {
+            per_node.emplace_back();
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &allowed)) per_node.back().push_back(cpu);
+            }
+        }
+
+        std::vector<int> ret;
+        for (uint64_t i = 0; ; i++)
+        {
+            bool any = false;
+            for (const auto & cpus : per_node)
+            {
+                if (i >= cpus.size()) continue;
+                ret.push_back(cpus[i]);
+                any = true;
+            }
+
+            if (!any) break;
+        }
+
+        return ret;
+    }
+
+    bool pin_current_thread(const int cpu)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+
+    bool interleave(void * address, const uint64_t size)
+    {
+        const auto nodes = online_nodes();
+        if (nodes.size() < 2 || size == 0) return false;
+
+        unsigned long max_node = 0;
+        const auto mask = node_mask(nodes, max_node);
+        return syscall(SYS_mbind, address, size, MPOL_INTERLEAVE_, mask.data(), max_node, 0) == 0;
+    }
+
+    bool interleave_current_thread(const bool enable)
+    {
+        const auto nodes = online_nodes();
+        if (nodes.size() < 2) return false;
+        if (!enable) return syscall(SYS_set_mempolicy, MPOL_DEFAULT_, nullptr, 0) == 0;
+
+        unsigned long max_node = 0;
+        const auto mask = node_mask(nodes, max_node);
+        return syscall(SYS_set_mempolicy, MPOL_INTERLEAVE_, mask.data(), max_node) == 0;
+    }
+}
@@ -0,0 +1,188 @@
+#include "scheduler.h"
+#include <algorithm>
+#include <utility>
+
+namespace lzw
+{
+    work_stealing_pool::work_stealing_pool(const uint64_t workers)
+    {
+        const auto count = std::max<uint64_t>(workers, 1);
+        queues_.reserve(count);
+        for (uint64_t worker = 0; worker < count; worker++) {
+            queues_.emplace_back(std::make_unique<worker_queue_t>());
+        }
+
+        threads_.reserve(count);
+        for (uint64_t worker = 0; worker < count; worker++) {
+            threads_.emplace_back(&work_stealing_pool::worker_main, this, worker);
+        }
+    }
+
+    work_stealing_pool::~work_stealing_pool()
+    {
+        cancel();
+        {
+            std::unique_lock lock(mutex_);
+            job_done_.wait(lock, [&] { return running_ == 0; });
+            stop_ = true;
+        }
+
+        job_ready_.notify_all();
+        for (auto & thread : threads_) {
+            if (thread.joinable()) thread.join();
+        }
+    }
+
+    void work_stealing_pool::cancel() noexcept
+    {
+        for (const auto & queue : queues_)
+        {
+            std::lock_guard lock(queue->mutex);
+            queue->begin = queue->end;
+            queue->cancelled = true;
+        }
+    }
+
+    void work_stealing_pool::submit(const uint64_t first, const uint64_t last, task_t task)
+    {
+        std::unique_lock lock(mutex_);
+        job_done_.wait(lock, [&] { return running_ == 0; });
+
+        task_ = std::move(task);
+        broadcast_ = nullptr;
+        error_ = nullptr;
+
+        // contiguous, nearly equal ranges keep every worker on neighbouring tasks
+        const uint64_t tasks = last > first ? last - first : 0;
+        const uint64_t workers = queues_.size();
+        for (uint64_t worker = 0; worker < workers; worker++)
+        {
+            std::lock_guard queue_lock(queues_[worker]->mutex);
+            queues_[worker]->begin = first + tasks * worker / workers;
+            queues_[worker]->end = first + tasks * (worker + 1) / workers;
+            queues_[worker]->cancelled = false;
+        }
+
+        running_ = workers;
+        ++generation_;
+        lock.unlock();
+        job_ready_.notify_all();
+    }
+
+    void work_stealing_pool::for_each_worker(std::function<void(uint64_t worker)> fn)
+    {
+        {
+            std::unique_lock lock(mutex_);
+            job_done_.wait(lock, [&] { return running_ == 0; });
+            broadcast_ = std::move(fn);
+            error_ = nullptr;
+            running_ = queues_.size();
+            ++generation_;
+        }
+
+        job_ready_.notify_all();
+        wait();
+    }
+
+    void work_stealing_pool::wait()
+    {
+        std::unique_lock lock(mutex_);
+        job_done_.wait(lock, [&] { return running_ == 0; });
+        if (error_) {
+            std::rethrow_exception(std::exchange(error_, nullptr));
+        }
+    }
+
+    bool work_stealing_pool::pop(const uint64_t worker, uint64_t & task)
+    {
+        auto & queue = *queues_[worker];
+        std::lock_guard lock(queue.mutex);
+        if (queue.begin == queue.end) return false;
+        task = queue.begin++;
+        return true;
+    }
+
+    bool work_stealing_pool::steal(const uint64_t worker, uint64_t & task)
+    {
+        const uint64_t workers = queues_.size();
+        for (uint64_t offset = 1; offset < workers; offset++)
+        {
+            auto & victim = *queues_[(worker + offset) % workers];
+            uint64_t begin = 0, end = 0;
+            {
+                std::lock_guard lock(victim.mutex);
+                const uint64_t remaining = victim.end - victim.begin;
+                if (remaining == 0) continue;
+
+                // take the back half, the victim keeps the tasks it is about to reach
+                const uint64_t take = (remaining + 1) / 2;
+                begin = victim.end - take;
+                end = victim.end;
+                victim.end = begin;
+            }
+
+            // cancel() may have swept this queue while the range was taken, it must not come back
+            auto & own = *queues_[worker];
+            std::lock_guard lock(own.mutex);
+            if (own.cancelled) return false;
+            own.begin = begin + 1;
+            own.end = end;
+            task = begin;
+            if (own.stats) own.stats->steals++;
+            return true;
+        }
+
+        return false;
+    }
+
+    void work_stealing_pool::worker_main(const uint64_t worker)
+    {
+        uint64_t seen = 0;
+        while (true)
+        {
+            {
+                std::unique_lock lock(mutex_);
+                const auto start = stats::clock::now();
+                job_ready_.wait(lock, [&] { return stop_ || generation_ != seen; });
+                if (stop_) return;
+                seen = generation_;
+                if (auto * worker_stats = queues_[worker]->stats) worker_stats->wait(start, stats::clock::now());
+            }
+
+            auto fail = [&]
+            {
+                {
+                    std::lock_guard lock(mutex_);
+                    if (!error_) error_ = std::current_exception();
+                }
+                cancel();
+            };
+
+            if (broadcast_)
+            {
+                try {
+                    broadcast_(worker);
+                } catch (...) {
+                    fail();
+                }
+            }
+            else
+            {
+                uint64_t task = 0;
+                while (pop(worker, task) || steal(worker, task))
+                {
+                    try {
+                        task_(worker, task);
+                    } catch (...) {
+                        fail();
+                    }
+                }
+            }
+
+            std::lock_guard lock(mutex_);
+            if (--running_ == 0) {
+                job_done_.notify_all();
+            }
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#include "stats.h"
+#include "cpu_features.h"
+
+namespace lzw::stats
+{
+    void thread_stats_t::record(const stage_t stage, const clock::time_point start, const clock::time_point end,
+        const uint64_t bytes_in, const uint64_t bytes_out)
+    {
+        auto & [nanoseconds, calls, in, out] = stages[stage];
+        nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        calls++;
+        in += bytes_in;
+        out += bytes_out;
+    }
+
+    void thread_stats_t::wait(const clock::time_point start, const clock::time_point end)
+    {
+        queue_wait_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    }
+
+    void stopwatch::lap(const stage_t stage, const uint64_t bytes_in, const uint64_t bytes_out)
+    {
+        if (!stats_) return;
+        const auto now = clock::now();
+        stats_->record(stage, start_, now, bytes_in, bytes_out);
+        start_ = now;
+    }
+
+    static void thread_to_json(std::ostream & os, const std::string & name, const thread_stats_t & stats)
+    {
+        os << "    { \"thread\": " << name
+           << ", \"blocks\": " << stats.blocks
+           << ", \"dictionary_resets\": " << stats.dictionary_resets
+           << ", \"queue_wait_ns\": " << stats.queue_wait_nanoseconds
+           << ", \"steals\": " << stats.steals
+           << ", \"stages\": {";
+
+        bool first = true;
+        for (uint64_t stage = 0; stage < StageCount; stage++)
+        {
+            const auto & [nanoseconds, calls, bytes_in, bytes_out] = stats.stages[stage];
+            if (calls == 0) continue;
+            os << (first ? " " : ", ") << "\"" << stage_name[stage] << "\": { \"ns\": " << nanoseconds
+               << ", \"calls\": " << calls << ", \"bytes_in\": " << bytes_in << ", \"bytes_out\": " << bytes_out << " }";
+            first = false;
+        }
+
+        os << " } }";
+    }
+
+    void collector::to_json(std::ostream & os, const std::string & mode) const
+    {
+        thread_stats_t total = main_;
+        for (const auto & worker : workers_)
+        {
+            total.blocks += worker.blocks;
+            total.dictionary_resets += worker.dictionary_resets;
+            total.queue_wait_nanoseconds += worker.queue_wait_nanoseconds;
+            total.steals += worker.steals;
+            for (uint64_t stage = 0; stage < StageCount; stage++)
+            {
+                total.stages[stage].nanoseconds += worker.stages[stage].nanoseconds;
+                total.stages[stage].calls += worker.stages[stage].calls;
+                total.stages[stage].bytes_in += worker.stages[stage].bytes_in;
+                total.stages[stage].bytes_out += worker.stages[stage].bytes_out;
+            }
+        }
+
+        os << "{\n  \"mode\": \"" << mode << "\",\n"
+           << "  \"wall_ns\": " << std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start_).count() << ",\n"
+           << "  \"workers\": " << workers_.size() << ",\n"
+           << "  \"cpu_features\": \"" << cpu::describe(cpu::active()) << "\",\n"
+           << "  \"threads\": [\n";
+        thread_to_json(os, "\"main\"", main_);
+        for (uint64_t slot = 0; slot < workers_.size(); slot++)
+        {
+            os << ",\n";
+            thread_to_json(os, std::to_string(slot), workers_[slot]);
+        }
+        os << "\n  ],\n  \"total\":\n";
+        thread_to_json(os, "\"all\"", total);
+        os << "\n}\n";
+    }
+}
@@ -0,0 +1,82 @@
+#include "archive.h"
+#include <random>
+#include <sstream>
+
+int main()
+{
+    std::mt19937 rng(0xA5C1);
+    std::vector < std::vector<uint8_t> > files(5);
+    for (uint64_t i = 0; i < files.size(); i++)
+    {
+        files[i].resize(i == 0 ? 0 : 20000 * i);
+        for (auto & byte : files[i]) byte = static_cast<uint8_t>(i % 2 ? rng() % 16 : rng());
+    }
+
+    lzw::work_stealing_pool pool(2);
+    lzw::block_pipeline pipeline(pool, nullptr);
+
+    // members added either way read back the same
+    std::ostringstream packed;
+    lzw::archive::writer writer(packed, 4095);
+    for (uint64_t i = 0; i < files.size(); i++)
+    {
+        const auto name = "dir/file" + std::to_string(i);
+        if (i % 2) {
+            writer.add(pipeline, name, files[i]);
+        } else {
+            std::vector<uint8_t> container;
+            pool.run(0, 1, [&](const uint64_t worker, uint64_t) { pipeline.compress_on(worker, files[i], 4095, container); });
+            writer.add_container(name, files[i].size(), lzw::archive::checksum(files[i]), container);
+        }
+    }
+
+    try {
+        writer.add(pipeline, "dir/file1", files[1]);
+        return 1;
+    } catch (const std::invalid_argument &) { }
+    writer.finish();
+
+    const auto archive = packed.str();
+    const std::span bytes(reinterpret_cast<const uint8_t *>(archive.data()), archive.size());
+    const lzw::archive::reader reader(bytes);
+    if (reader.members().size() != files.size() || reader.find("missing") != nullptr) return 1;
+    for (uint64_t i = files.size(); i-- > 0;)
+    {
+        const auto * member = reader.find("dir/file" + std::to_string(i));
+        if (!member || member->original_size != files[i].size()) return 1;
+
+        std::ostringstream restored;
+        if (reader.extract(pipeline, *member, restored) != files[i].size()) return 1;
+        if (restored.str() != std::string(files[i].begin(), files[i].end())) return 1;
+
+        std::vector<uint8_t> restored_serial;
+        pool.run(0, 1, [&](const uint64_t worker, uint64_t) { reader.extract_on(pipeline, worker, *member, restored_serial); });
+        if (restored_serial != files[i]) return 1;
+    }
+
+    // a damaged member fails its checksum, the others still extract
+    auto damaged = archive;
+    const auto & victim = reader.members()[3];
+    damaged[victim.offset + victim.compressed_size / 2] ^= 0x10;
+    const lzw::archive::reader damaged_reader({ reinterpret_cast<const uint8_t *>(damaged.data()), damaged.size() });
+    try {
+        std::ostringstream ignored;
+        damaged_reader.extract(pipeline, *damaged_reader.find("dir/file3"), ignored);
+        return 1;
+    } catch (const std::exception &) { }
+    std::ostringstream intact;
+    damaged_reader.extract(pipeline, *damaged_reader.find("dir/file1"), intact);
+
+    // damaged directory and non-archives are rejected
+    for (const uint64_t position : { archive.size() - sizeof(lzw::archive::footer_t) - 3, 0ul, archive.size() - 1 })
+    {
+        auto corrupted = archive;
+        corrupted[position] ^= 0x01;
+        try {
+            lzw::archive::reader rejected({ reinterpret_cast<const uint8_t *>(corrupted.data()), corrupted.size() });
+            return 1;
+        } catch (const std::runtime_error &) { }
+    }
+
+    return 0;
+}
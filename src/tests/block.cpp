@@ -0,0 +1,403 @@
+#include "block.h"
+#include <algorithm>
+#include <random>
+#include <string>
+#include <tuple>
+
+int main()
+{
+    std::mt19937 rng(0x5EED);
+    std::vector < std::vector<uint8_t> > samples;
+
+    auto random_block = [&](const uint64_t size, const uint32_t alphabet)
+    {
+        std::uniform_int_distribution<uint32_t> dist(0, alphabet - 1);
+        std::vector<uint8_t> block(size);
+        for (auto & c : block) c = static_cast<uint8_t>(dist(rng));
+        return block;
+    };
+
+    const std::string text = "the quick brown fox jumps over the lazy dog, again and again and again. ";
+    std::vector<uint8_t> repeated;
+    while (repeated.size() < lzw::block_codec::block_size) repeated.insert(repeated.end(), text.begin(), text.end());
+    repeated.resize(lzw::block_codec::block_size);
+
+    samples.emplace_back();
+    samples.emplace_back(1, 'x');
+    samples.emplace_back(lzw::block_codec::block_size, 0);
+    samples.push_back(repeated);
+    samples.push_back(random_block(lzw::block_codec::block_size, 256));
+    samples.push_back(random_block(lzw::block_codec::block_size, 4));
+    samples.push_back(random_block(17, 2));
+    samples.push_back(random_block(1 << 16, 256)); // forces dictionary resets
+
+    // one instance of everything, reused across all samples, twice
+    lzw::block_codec codec;
+    lzw::lzw<12> LZW;
+    lzw::Huffman huffman;
+    std::vector<uint8_t> packed, unpacked;
+    for (int round = 0; round < 2; round++)
+    {
+        for (const auto & sample : samples)
+        {
+            if (sample.size() <= lzw::block_codec::block_size)
+            {
+                codec.compress(sample, packed);
+                codec.decompress(packed, unpacked);
+                if (unpacked != sample) return 1;
+            }
+
+            LZW.compress(sample, packed);
+            LZW.decompress(packed, unpacked);
+            if (unpacked != sample) return 1;
+
+            huffman.compress(sample, packed);
+            huffman.decompress(packed, unpacked);
+            if (unpacked != sample) return 1;
+        }
+
+        codec.reset();
+    }
+
+    // Fibonacci weights give Huffman codes as long as the symbol count minus one, which takes the
+    // encoder through every number of codes packed per flush
+    for (const uint64_t symbols : { 15ul, 16ul, 19ul, 20ul, 29ul, 30ul })
+    {
+        std::vector<uint8_t> skewed;
+        for (uint64_t sym = 0, weight = 1, next = 1; sym < symbols; sym++, std::tie(weight, next) = std::pair(next, weight + next)) {
+            skewed.insert(skewed.end(), weight, static_cast<uint8_t>(sym));
+        }
+
+        std::ranges::shuffle(skewed, rng);
+        huffman.compress(skewed, packed);
+        huffman.decompress(packed, unpacked);
+        if (unpacked != skewed) return 1;
+    }
+
+    // bound interface produces the same stream as the reusable one
+    std::vector<uint8_t> bound_output;
+    lzw::lzw<12> bound(repeated, bound_output);
+    bound.compress();
+    LZW.compress(repeated, packed);
+    if (bound_output != packed) return 1;
+
+    // container index finds every section and rejects truncation
+    std::vector<uint8_t> container;
+    for (const auto & sample : samples)
+    {
+        if (sample.size() > lzw::block_codec::block_size) continue;
+        codec.compress(sample, packed);
+        const auto size = static_cast<uint16_t>(packed.size());
+        container.push_back(static_cast<uint8_t>(size & 0xFF));
+        container.push_back(static_cast<uint8_t>(size >> 8));
+        container.insert(container.end(), packed.begin(), packed.end());
+    }
+
+    std::vector < lzw::block_ref_t > index;
+    lzw::index_blocks(container, index);
+    if (index.size() != samples.size() - 1) return 1;
+    for (uint64_t i = 0; i < index.size(); i++)
+    {
+        codec.decompress(std::span(container).subspan(index[i].offset, index[i].size), unpacked);
+        if (unpacked != samples[i]) return 1;
+    }
+
+    try {
+        lzw::index_blocks(std::span(container).first(container.size() - 1), index);
+        return 1;
+    } catch (const std::runtime_error &) { }
+
+    // continued dictionaries decode in order, across widths and full-dictionary resets,
+    // and a continued stream is never mistaken for a fresh one
+    std::vector < std::vector<uint8_t> > continued;
+    for (const uint64_t size : { 300ul, 0ul, 1ul, 4095ul, 40000ul, 4095ul, 70000ul, 4095ul }) {
+        continued.push_back(random_block(size, size > 40000 ? 256 : 16));
+    }
+
+    std::vector < std::vector<uint8_t> > streams;
+    for (uint64_t i = 0; i < continued.size(); i++) {
+        LZW.compress(continued[i], packed, i > 0);
+        streams.push_back(packed);
+    }
+
+    for (uint64_t i = 0; i < continued.size(); i++) {
+        LZW.decompress(streams[i], unpacked, i > 0);
+        if (unpacked != continued[i]) return 1;
+    }
+
+    try {
+        lzw::lzw<12>().decompress(streams[1], unpacked, true);
+        return 1;
+    } catch (const std::logic_error &) { }
+
+    // a group keeps carrying past Huffman blocks by restarting LZW, and its continued blocks need their predecessor
+    const std::vector < std::vector<uint8_t> > originals { continued[0], continued[3], samples[4], repeated, repeated, samples[5] };
+    std::vector < std::vector<uint8_t> > sections;
+    bool any_continued = false;
+    codec.begin_group();
+    for (const auto & sample : originals)
+    {
+        any_continued |= codec.compress(sample, packed, true) == lzw::block_codec::LZWContinuedSignature;
+        sections.push_back(packed);
+    }
+
+    if (!any_continued || sections[3].front() == lzw::block_codec::LZWContinuedSignature) return 1;
+    lzw::block_codec decoder;
+    for (uint64_t i = 0; i < sections.size(); i++)
+    {
+        decoder.decompress(sections[i], unpacked);
+        if (unpacked != originals[i]) return 1;
+    }
+
+    try {
+        decoder.begin_group();
+        decoder.decompress(sections[4], unpacked);
+        return 1;
+    } catch (const std::runtime_error &) { }
+
+    // every reset policy decodes with the same decoder, a frozen dictionary is never cleared and
+    // the monitor clears it once the data it was built on is gone
+    std::vector<uint8_t> shifting = samples[7];
+    shifting.insert(shifting.end(), repeated.begin(), repeated.end());
+    for (int i = 0; i < 16; i++) shifting.insert(shifting.end(), repeated.begin(), repeated.end());
+    uint64_t immediate_resets = 0;
+    for (const auto policy : { lzw::reset_policy_t::Immediate, lzw::reset_policy_t::Monitor, lzw::reset_policy_t::Freeze })
+    {
+        lzw::lzw<12> policed;
+        policed.set_reset_policy(policy);
+        for (const auto & sample : { samples[7], shifting })
+        {
+            policed.compress(sample, packed);
+            LZW.decompress(packed, unpacked);
+            if (unpacked != sample) return 1;
+        }
+
+        const auto resets = policed.dictionary_resets();
+        if (policy == lzw::reset_policy_t::Immediate) immediate_resets = resets;
+        if (policy == lzw::reset_policy_t::Monitor && (resets == 0 || resets >= immediate_resets)) return 1;
+        if (policy == lzw::reset_policy_t::Freeze && resets != 0) return 1;
+
+        for (uint64_t i = 0; i < continued.size(); i++) {
+            policed.compress(continued[i], packed, i > 0);
+            LZW.decompress(packed, unpacked, i > 0);
+            if (unpacked != continued[i]) return 1;
+        }
+    }
+
+    // LZMW and LZAP round trip alone, continued, and from a preset, and beat classic LZW on repeated phrases
+    const std::vector<uint32_t> preset_prefixes { 't', 258, 'a' };
+    const std::vector<uint8_t> preset_suffixes { 'h', 'e', 'n' };
+    lzw::lzmw<12> LZMW;
+    lzw::lzap<12> LZAP;
+    std::vector<uint8_t> classic_packed;
+    LZW.compress(repeated, classic_packed);
+    for (const bool preset : { false, true })
+    {
+        if (preset) {
+            LZMW.set_preset(preset_prefixes, preset_suffixes);
+            LZAP.set_preset(preset_prefixes, preset_suffixes);
+        }
+
+        for (const auto & sample : samples)
+        {
+            LZMW.compress(sample, packed);
+            LZMW.decompress(packed, unpacked);
+            if (unpacked != sample) return 1;
+
+            LZAP.compress(sample, packed);
+            LZAP.decompress(packed, unpacked);
+            if (unpacked != sample) return 1;
+        }
+
+        for (uint64_t i = 0; i < continued.size(); i++)
+        {
+            LZMW.compress(continued[i], packed, i > 0);
+            LZMW.decompress(packed, unpacked, i > 0);
+            if (unpacked != continued[i]) return 1;
+
+            LZAP.compress(continued[i], packed, i > 0);
+            LZAP.decompress(packed, unpacked, i > 0);
+            if (unpacked != continued[i]) return 1;
+        }
+    }
+
+    // the comparison runs on fresh coders, a preset would favour them
+    lzw::lzmw<12> fresh_lzmw;
+    lzw::lzap<12> fresh_lzap;
+    fresh_lzmw.compress(repeated, packed);
+    if (packed.size() >= classic_packed.size()) return 1;
+    fresh_lzap.compress(repeated, packed);
+    if (packed.size() >= classic_packed.size()) return 1;
+
+    // a block codec compressing one variant decodes every signature, continued blocks follow their group's variant
+    for (const auto & [growth, signature] : { std::pair { lzw::growth_t::LZMW, lzw::block_codec::LZMWSignature },
+                                              std::pair { lzw::growth_t::LZAP, lzw::block_codec::LZAPSignature } })
+    {
+        lzw::block_codec grown;
+        grown.set_growth(growth);
+        sections.clear();
+        bool any_variant = false;
+        any_continued = false;
+        for (const auto & sample : originals)
+        {
+            const auto kept = grown.compress(sample, packed, true);
+            any_variant |= kept == signature;
+            any_continued |= kept == lzw::block_codec::LZWContinuedSignature;
+            sections.push_back(packed);
+        }
+
+        if (!any_variant || !any_continued) return 1;
+        decoder.begin_group();
+        for (uint64_t i = 0; i < sections.size(); i++)
+        {
+            decoder.decompress(sections[i], unpacked);
+            if (unpacked != originals[i]) return 1;
+        }
+    }
+
+    // small alphabets run over their symbol ranks with narrower codes, and keep their group while later
+    // blocks use no other symbol
+    const std::string bases = "ACGT";
+    std::vector<uint8_t> motif, genome;
+    for (const auto rank : random_block(60, 4)) motif.push_back(static_cast<uint8_t>(bases[rank]));
+    while (genome.size() < 3 * lzw::block_codec::block_size)
+    {
+        genome.insert(genome.end(), motif.begin(), motif.end());
+        genome[genome.size() - 1 - rng() % motif.size()] = static_cast<uint8_t>(bases[rng() % 4]);
+    }
+
+    const std::vector < std::vector<uint8_t> > reads {
+        { genome.begin(), genome.begin() + lzw::block_codec::block_size },
+        { genome.begin() + lzw::block_codec::block_size, genome.begin() + 2 * lzw::block_codec::block_size },
+        { genome.begin() + 2 * lzw::block_codec::block_size, genome.begin() + 3 * lzw::block_codec::block_size },
+    };
+
+    lzw::block_codec alphabet;
+    sections.clear();
+    for (const auto & read : reads)
+    {
+        alphabet.compress(read, packed, true);
+        sections.push_back(packed);
+    }
+
+    LZW.compress(reads[0], classic_packed);
+    if (sections[0].front() != lzw::block_codec::AlphabetSignature || sections[0].size() >= classic_packed.size()
+        || sections[1].front() != lzw::block_codec::LZWContinuedSignature)
+    {
+        return 1;
+    }
+
+    // a symbol outside the alphabet starts a new group over every byte value, which the alphabet blocks after it continue
+    auto widened = reads[2];
+    widened[100] = 'N';
+    alphabet.compress(widened, packed, true);
+    if (packed.front() != lzw::block_codec::LZWSignature) return 1;
+    sections.push_back(packed);
+    alphabet.compress(reads[0], packed, true);
+    if (packed.front() != lzw::block_codec::LZWContinuedSignature) return 1;
+    sections.push_back(packed);
+
+    decoder.begin_group();
+    for (uint64_t i = 0; i < sections.size(); i++)
+    {
+        decoder.decompress(sections[i], unpacked);
+        if (unpacked != (i < reads.size() ? reads[i] : i == reads.size() ? widened : reads[0])) return 1;
+    }
+
+    try {
+        std::vector<uint8_t> empty_alphabet(1 + lzw::block_codec::alphabet_bitmap_size, 0);
+        empty_alphabet.front() = lzw::block_codec::AlphabetSignature;
+        decoder.decompress(empty_alphabet, unpacked);
+        return 1;
+    } catch (const std::invalid_argument &) { }
+
+    // with LZ77 on, a block repeating an earlier one of the group matches it from the LZ77 history,
+    // and does not start a group of its own
+    lzw::block_codec matched;
+    matched.set_lz77(lzw::lz77_mode_t::Lazy);
+    const std::vector < std::vector<uint8_t> > recurring { samples[4], repeated, samples[4] };
+    sections.clear();
+    for (const auto & sample : recurring)
+    {
+        matched.compress(sample, packed, true);
+        sections.push_back(packed);
+    }
+
+    if (sections.back().front() != lzw::block_codec::LZ77ContinuedSignature
+        || lzw::block_codec::starts_group(sections.back()) || sections.back().size() > 64)
+    {
+        return 1;
+    }
+
+    decoder.begin_group();
+    for (uint64_t i = 0; i < sections.size(); i++)
+    {
+        decoder.decompress(sections[i], unpacked);
+        if (unpacked != recurring[i]) return 1;
+    }
+
+    try {
+        decoder.begin_group();
+        decoder.decompress(sections.back(), unpacked);
+        return 1;
+    } catch (const std::runtime_error &) { }
+
+    // the history fed by other codecs is what the continued block reaches into
+    try {
+        decoder.begin_group();
+        decoder.set_lz77_history(false);
+        for (const auto & section : sections) decoder.decompress(section, unpacked);
+        if (unpacked == recurring.back()) return 1;
+    } catch (const std::exception &) { }
+    decoder.set_lz77_history(true);
+
+    try {
+        matched.set_lz77(lzw::lz77_mode_t::Greedy, lzw::lz77::MinWindowLog - 1);
+        return 1;
+    } catch (const std::invalid_argument &) { }
+
+    // blocks no codec shrinks are stored, and the guided selection runs one codec per block yet decodes alike.
+    // LZ77 also reaches into the blocks it did not run on
+    codec.begin_group();
+    codec.compress(samples[4], packed, true);
+    if (packed.front() != lzw::block_codec::StoredSignature || packed.size() != samples[4].size() + 1) return 1;
+    decoder.begin_group();
+    decoder.decompress(packed, unpacked);
+    if (unpacked != samples[4]) return 1;
+
+    std::vector<uint8_t> mixed(samples[5].begin(), samples[5].begin() + 2000);
+    mixed.insert(mixed.end(), repeated.begin(), repeated.begin() + 2000);
+    const std::vector < std::vector<uint8_t> > guided_blocks { repeated, samples[5], mixed, samples[4], samples[2] };
+    for (const auto mode : { lzw::lz77_mode_t::Off, lzw::lz77_mode_t::Fast, lzw::lz77_mode_t::Greedy })
+    {
+        lzw::block_codec guided;
+        guided.set_selection(lzw::selection_t::Guided);
+        guided.set_lz77(mode);
+        sections.clear();
+        for (const auto & sample : guided_blocks)
+        {
+            guided.compress(sample, packed, true);
+            sections.push_back(packed);
+        }
+
+        if (sections[1].front() != lzw::block_codec::HuffmanSignature) return 1;
+        if (mode != lzw::lz77_mode_t::Off && sections[2].front() != lzw::block_codec::LZ77ContinuedSignature) return 1;
+        decoder.begin_group();
+        for (uint64_t i = 0; i < sections.size(); i++)
+        {
+            decoder.decompress(sections[i], unpacked);
+            if (unpacked != guided_blocks[i]) return 1;
+        }
+    }
+
+    // version 1 stream headers always name a dictionary
+    const std::vector<uint8_t> version1 { 'L', 'Z', '#', 1, 0x78, 0x56, 0x34, 0x12 };
+    lzw::stream_header_t header { };
+    if (lzw::read_stream_header(version1, header) != lzw::stream_header_t::Version1Size
+        || header.dictionary_id != 0x12345678 || header.flags != lzw::stream_header_t::HasDictionary || header.level != 0)
+    {
+        return 1;
+    }
+
+    return 0;
+}
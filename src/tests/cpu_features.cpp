@@ -0,0 +1,97 @@
+#include "cpu_features.h"
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include "cppcrc.h"
+
+int main()
+{
+    std::mt19937_64 rng(0xC9F0);
+    std::vector<uint8_t> data(1 << 20);
+    for (auto & byte : data) byte = static_cast<uint8_t>(rng() % 5 == 0 ? rng() : rng() % 9);
+
+    // the check value of the CRC32 catalogue, through every path
+    const std::string check = "123456789";
+    const std::span check_bytes(reinterpret_cast<const uint8_t *>(check.data()), check.size());
+
+    // every subset of what this CPU has binds kernels giving the generic results
+    const auto & detected = lzw::cpu::detected();
+    const auto generic = lzw::cpu::kernels_for({ });
+    for (uint64_t subset = 0; subset < 32; subset++)
+    {
+        lzw::cpu::features_t features {
+            .sse42 = (subset & 1) && detected.sse42,
+            .pclmul = (subset & 2) && detected.pclmul,
+            .avx2 = (subset & 4) && detected.avx2,
+            .bmi2 = (subset & 8) && detected.bmi2,
+            .avx512 = (subset & 16) && detected.avx512,
+        };
+        const auto kernels = lzw::cpu::kernels_for(features);
+
+        if (kernels.crc32(check_bytes, 0) != 0xCBF43926) return 1;
+        for (uint64_t size = 0; size < 300; size++)
+        {
+            const auto slice = std::span(data).subspan(rng() % 4096, size);
+            const auto prior = static_cast<uint32_t>(rng());
+            if (kernels.crc32(slice, prior) != CRC32::CRC32::calc(slice.data(), slice.size(), prior)) return 1;
+        }
+
+        // continuing across splits gives the CRC of the whole
+        const uint32_t whole = generic.crc32(data, 0);
+        if (kernels.crc32(data, 0) != whole) return 1;
+        if (kernels.crc32(std::span(data).subspan(777), kernels.crc32(std::span(data).first(777), 0)) != whole) return 1;
+
+        lzw::histogram_t histogram { }, expected { };
+        kernels.histogram(data, histogram);
+        generic.histogram(data, expected);
+        if (histogram != expected) return 1;
+
+        // packing at every kernel width, up to codes that need two halves
+        for (const uint64_t longest : { 1, 9, 14, 18, 28, 56, 58 })
+        {
+            alignas(64) std::array < uint64_t, 256 > table { };
+            for (uint64_t sym = 0; sym < 256; sym++)
+            {
+                const uint64_t length = sym == 0 ? longest : rng() % longest + 1;
+                table[sym] = (rng() & ((1ULL << length) - 1)) | length << lzw::CodeLengthShift;
+            }
+
+            const auto src = std::span(data).subspan(rng() % 4096, 10000 + rng() % 64);
+            std::vector<uint8_t> packed(src.size() * longest / 8 + 16, 0), reference(packed.size(), 0);
+            lzw::code_packer_t packer { .out = packed.data(), .acc = 0, .fill = 0 };
+            lzw::code_packer_t reference_packer { .out = reference.data(), .acc = 0, .fill = 0 };
+            kernels.pack_codes(src, table.data(), longest, packer);
+            generic.pack_codes(src, table.data(), longest, reference_packer);
+            if (packed != reference || packer.out - packed.data() != reference_packer.out - reference.data()
+                || packer.fill != reference_packer.fill || packer.acc != reference_packer.acc)
+            {
+                return 1;
+            }
+        }
+    }
+
+    // the override binds what it is given, and only names this CPU has
+    lzw::cpu::restrict_to("none");
+    if (lzw::cpu::active() != lzw::cpu::features_t { } || lzw::cpu::describe(lzw::cpu::active()) != "none") return 1;
+    if (lzw::cpu::kernels().crc32 != generic.crc32 || lzw::cpu::kernels().pack_codes != generic.pack_codes) return 1;
+
+    lzw::cpu::restrict_to("native");
+    if (lzw::cpu::active() != detected) return 1;
+    lzw::cpu::restrict_to(lzw::cpu::describe(detected));
+    if (lzw::cpu::active() != detected) return 1;
+
+    try {
+        lzw::cpu::restrict_to("sse4.2,mmx");
+        return 1;
+    } catch (const std::invalid_argument &) { }
+
+    if (!detected.avx512)
+    {
+        try {
+            lzw::cpu::restrict_to("avx512");
+            return 1;
+        } catch (const std::runtime_error &) { }
+    }
+
+    return 0;
+}
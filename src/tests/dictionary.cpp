@@ -0,0 +1,132 @@
+#include "dictionary.h"
+#include "pipeline.h"
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+
+int main()
+{
+    std::mt19937 rng(0xD1C7);
+    auto message = [&]()
+    {
+        std::string text = "{\"method\":\"orders.list\",\"tenant\":\"acme\",\"items\":[";
+        for (uint64_t i = rng() % 20; i > 0; i--) {
+            text += "{\"sku\":\"SKU-" + std::to_string(rng() % 1000) + "\",\"quantity\":" + std::to_string(rng() % 9) + "},";
+        }
+
+        return text + "]}";
+    };
+
+    std::vector<std::string> messages;
+    std::vector<std::span<const uint8_t>> samples;
+    for (uint64_t i = 0; i < 300; i++) messages.push_back(message());
+    for (const auto & text : messages) samples.emplace_back(reinterpret_cast<const uint8_t *>(text.data()), text.size());
+
+    const auto dictionary = lzw::train_dictionary(samples, 4095, 512);
+    if (dictionary.lzw_prefix.empty() || dictionary.lzw_prefix.size() > 512) return 1;
+
+    // a block filling the dictionary starts it over, so phrases after the first fill are learned as well
+    std::vector<uint8_t> filling;
+    while (filling.size() < 20000) filling.push_back(static_cast<uint8_t>(rng() % 128));
+    const std::string motif = "\xC8\xC9\xCA\xCB\xCC\xCD\xCE\xCF";
+    while (filling.size() < 60000) filling.insert(filling.end(), motif.begin(), motif.end());
+    const std::span<const uint8_t> filling_sample(filling);
+    const auto late = lzw::train_dictionary(std::span(&filling_sample, 1), filling.size(), 256);
+    bool late_phrase = false;
+    for (uint64_t i = 0; i < late.lzw_prefix.size(); i++) late_phrase |= late.lzw_prefix[i] >= 258 && late.lzw_suffix[i] >= 0xC8;
+    if (!late_phrase) return 1;
+
+    // survives a save/load round trip, and a damaged file is rejected
+    const std::string path = "/tmp/lzw_dictionary_test.lzd";
+    lzw::save_dictionary(dictionary, path);
+    const auto loaded = lzw::load_dictionary(path);
+    if (loaded.id != dictionary.id || loaded.lzw_prefix != dictionary.lzw_prefix
+        || loaded.lzw_suffix != dictionary.lzw_suffix || loaded.huffman_lengths != dictionary.huffman_lengths) return 1;
+
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(20);
+        file.put('\x7f');
+    }
+
+    try {
+        (void)lzw::load_dictionary(path);
+        return 1;
+    } catch (const std::runtime_error &) { }
+
+    // every block codec form round-trips with a dictionary, unseen messages get smaller
+    lzw::block_codec plain, trained;
+    trained.set_dictionary(&dictionary);
+    std::vector<uint8_t> packed, unpacked;
+    uint64_t plain_size = 0, trained_size = 0;
+    std::vector<std::string> inputs { "", "x", std::string(500, 'a') };
+    for (uint64_t i = 0; i < 50; i++) inputs.push_back(message());
+    std::string noise;
+    for (uint64_t i = 0; i < 4000; i++) noise.push_back(static_cast<char>(rng()));
+    inputs.push_back(noise);
+    for (const auto & input : inputs)
+    {
+        const std::span<const uint8_t> data(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+        plain.compress(data, packed);
+        plain_size += packed.size();
+        trained.compress(data, packed);
+        trained_size += packed.size();
+        trained.decompress(packed, unpacked);
+        if (!std::ranges::equal(unpacked, data)) return 1;
+    }
+
+    if (trained_size >= plain_size) return 1;
+
+    // short Huffman blocks drop their own table for the preset
+    lzw::Huffman huffman;
+    huffman.set_preset(dictionary.huffman_lengths);
+    std::string shuffled = messages[0];
+    std::ranges::shuffle(shuffled, rng);
+    const std::span<const uint8_t> shuffled_bytes(reinterpret_cast<const uint8_t *>(shuffled.data()), shuffled.size());
+    huffman.compress(shuffled_bytes, packed);
+    if (packed.front() != 0xDD) return 1;
+    huffman.decompress(packed, unpacked);
+    if (!std::ranges::equal(unpacked, shuffled_bytes)) return 1;
+
+    // streams name their dictionary and refuse to decode without it
+    lzw::work_stealing_pool pool(2);
+    lzw::block_pipeline pipeline(pool, nullptr);
+    std::string all;
+    for (const auto & input : inputs) all += input;
+    const std::span<const uint8_t> data(reinterpret_cast<const uint8_t *>(all.data()), all.size());
+
+    std::ostringstream container;
+    pipeline.set_dictionary(&dictionary);
+    pipeline.compress(data, 1024, container);
+    const auto stream = container.str();
+    const std::span<const uint8_t> stream_bytes(reinterpret_cast<const uint8_t *>(stream.data()), stream.size());
+    lzw::stream_header_t header { };
+    if (lzw::read_stream_header(stream_bytes, header) != sizeof(header) || header.dictionary_id != dictionary.id) return 1;
+
+    std::ostringstream restored;
+    pipeline.decompress(stream_bytes, restored);
+    if (restored.str() != all) return 1;
+
+    std::vector<uint8_t> restored_serial;
+    pool.run(0, 1, [&](const uint64_t worker, uint64_t) { pipeline.decompress_on(worker, stream_bytes, restored_serial); });
+    if (!std::ranges::equal(restored_serial, data)) return 1;
+
+    pipeline.set_dictionary(nullptr);
+    try {
+        std::ostringstream ignored;
+        pipeline.decompress(stream_bytes, ignored);
+        return 1;
+    } catch (const std::runtime_error &) { }
+
+    // streams without a header still decode while a dictionary is set
+    std::ostringstream headerless, restored_headerless;
+    pipeline.compress(data, 1024, headerless);
+    pipeline.set_dictionary(&dictionary);
+    const auto headerless_stream = headerless.str();
+    pipeline.decompress({ reinterpret_cast<const uint8_t *>(headerless_stream.data()), headerless_stream.size() }, restored_headerless);
+    if (restored_headerless.str() != all) return 1;
+
+    return 0;
+}
@@ -0,0 +1,30 @@
+#include "histogram.h"
+#include <random>
+#include <vector>
+
+int main()
+{
+    std::mt19937_64 rng(0x4157);
+    std::vector<uint8_t> data(1 << 20);
+    for (uint64_t i = 0; i < data.size(); i++) {
+        data[i] = i < data.size() / 2 ? static_cast<uint8_t>(rng() % 7) : static_cast<uint8_t>(rng());
+    }
+
+    std::fill_n(data.begin() + 1000, 5000, 0x42); // a long run hits one counter of every sub-histogram
+
+    // every size around the small input cutoff and the 16 byte step, at every alignment, accumulating
+    lzw::histogram_t histogram { }, expected { };
+    for (uint64_t size = 0; size < 600; size++)
+    {
+        const auto slice = std::span(data).subspan(rng() % 4096, size);
+        lzw::accumulate_histogram(slice, histogram);
+        for (const auto c : slice) expected[c]++;
+        if (histogram != expected) return 1;
+    }
+
+    lzw::accumulate_histogram(data, histogram);
+    for (const auto c : data) expected[c]++;
+    if (histogram != expected) return 1;
+
+    return 0;
+}
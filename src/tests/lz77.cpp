@@ -0,0 +1,133 @@
+#include "lz77.h"
+#include <random>
+#include <string>
+#include <vector>
+
+int main()
+{
+    std::mt19937 rng(0x7A77);
+    auto random_block = [&](const uint64_t size, const uint32_t alphabet)
+    {
+        std::uniform_int_distribution<uint32_t> dist(0, alphabet - 1);
+        std::vector<uint8_t> block(size);
+        for (auto & c : block) c = static_cast<uint8_t>(dist(rng));
+        return block;
+    };
+
+    const std::string text = "the quick brown fox jumps over the lazy dog, again and again and again. ";
+    std::vector<uint8_t> repeated;
+    while (repeated.size() < 40000) repeated.insert(repeated.end(), text.begin(), text.end());
+
+    std::vector < std::vector<uint8_t> > samples;
+    samples.emplace_back();
+    samples.emplace_back(1, 'x');
+    samples.emplace_back(3, 'y');
+    samples.emplace_back(lzw::lz77::MaxBlockSize, 0);
+    samples.push_back(repeated);
+    samples.push_back(random_block(4095, 256));
+    samples.push_back(random_block(4095, 4));
+    samples.push_back(random_block(lzw::lz77::MaxBlockSize, 256));
+
+    // every block alone, and every block continuing the ones before, in both modes and a small window
+    lzw::lz77 encoder, decoder;
+    std::vector<uint8_t> packed, unpacked;
+    for (const auto mode : { lzw::lz77_mode_t::Fast, lzw::lz77_mode_t::Greedy, lzw::lz77_mode_t::Lazy })
+    {
+        for (const uint64_t window_log : { lzw::lz77::MinWindowLog, lzw::lz77::DefaultWindowLog, lzw::lz77::MaxWindowLog })
+        {
+            encoder.set_mode(mode, window_log);
+            for (const bool continued : { false, true })
+            {
+                decoder.reset();
+                for (uint64_t round = 0; round < 3; round++)
+                {
+                    for (uint64_t i = 0; i < samples.size(); i++)
+                    {
+                        const bool carry = continued && (round > 0 || i > 0);
+                        encoder.compress(samples[i], packed, carry);
+                        decoder.decompress(packed, unpacked, carry);
+                        if (unpacked != samples[i]) return 1;
+                    }
+                }
+            }
+        }
+    }
+
+    // a block repeating one far back in the history costs a few bytes, also past blocks another codec decoded
+    const auto far = random_block(30000, 256);
+    const auto between = random_block(20000, 256);
+    encoder.set_mode(lzw::lz77_mode_t::Lazy, 16);
+    encoder.compress(far, packed);
+    encoder.compress(between, packed, true);
+    encoder.compress(far, packed, true);
+    if (packed.size() > 64) return 1;
+
+    decoder.reset();
+    decoder.append_history(far, false);
+    decoder.append_history(between, true);
+    decoder.decompress(packed, unpacked, true);
+    if (unpacked != far) return 1;
+
+    encoder.skip(far, false);
+    encoder.skip(between, true);
+    encoder.compress(far, packed, true);
+    if (packed.size() > 64) return 1;
+    decoder.append_history(far, false);
+    decoder.append_history(between, true);
+    decoder.decompress(packed, unpacked, true);
+    if (unpacked != far) return 1;
+
+    // lazy matching never loses to greedy on text
+    std::vector<uint8_t> greedy_packed;
+    encoder.set_mode(lzw::lz77_mode_t::Greedy, 16);
+    encoder.compress(repeated, greedy_packed);
+    encoder.set_mode(lzw::lz77_mode_t::Lazy, 16);
+    encoder.compress(repeated, packed);
+    if (packed.size() > greedy_packed.size()) return 1;
+
+    try {
+        encoder.set_mode(lzw::lz77_mode_t::Greedy, lzw::lz77::MaxWindowLog + 1);
+        return 1;
+    } catch (const std::invalid_argument &) { }
+
+    try {
+        encoder.compress(std::vector<uint8_t>(lzw::lz77::MaxBlockSize + 1), packed);
+        return 1;
+    } catch (const std::invalid_argument &) { }
+
+    // a continued block needs the blocks before it, all of them
+    encoder.compress(far, packed);
+    encoder.compress(far, packed, true);
+    try {
+        lzw::lz77().decompress(packed, unpacked, true);
+        return 1;
+    } catch (const std::runtime_error &) { }
+
+    // distances are sized by the history, so a shorter one cannot give back the block
+    try {
+        decoder.reset();
+        decoder.append_history(samples[1], false);
+        decoder.decompress(packed, unpacked, true);
+        if (unpacked == far) return 1;
+    } catch (const std::invalid_argument &) { }
+
+    // corrupted headers and truncated streams are rejected
+    encoder.compress(repeated, packed);
+    for (const auto & corrupt : { std::vector<uint8_t> { }, std::vector<uint8_t>(1, 16),
+                                  std::vector<uint8_t>(packed.begin(), packed.begin() + packed.size() / 2) })
+    {
+        try {
+            decoder.decompress(corrupt, unpacked);
+            return 1;
+        } catch (const std::exception &) { }
+    }
+
+    auto bad_window = packed;
+    bad_window[0] = static_cast<uint8_t>(lzw::lz77::MaxWindowLog + 1);
+    try {
+        decoder.decompress(bad_window, unpacked);
+        return 1;
+    } catch (const std::invalid_argument &) { }
+
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include "pipeline.h"
+#include <random>
+#include <sstream>
+#include <tuple>
+
+int main()
+{
+    std::mt19937 rng(0x5EED);
+    std::vector<uint8_t> data(300000);
+    for (uint64_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>(i % 5000 < 2500 ? rng() % 8 : rng());
+    }
+
+    lzw::work_stealing_pool pool(3);
+    lzw::block_pipeline pipeline(pool, nullptr);
+    for (const uint64_t block_size : { 1ul, 100ul, 4095ul, lzw::block_codec::max_block_size })
+    {
+        const auto sample = std::span(data).first(block_size == 1 ? 5000 : data.size());
+
+        // parallel and single-worker paths produce the same container
+        std::ostringstream parallel;
+        const auto written = pipeline.compress(sample, block_size, parallel);
+        const auto container = parallel.str();
+        if (written != container.size()) return 1;
+
+        std::vector<uint8_t> serial;
+        pool.run(0, 1, [&](const uint64_t worker, uint64_t) { pipeline.compress_on(worker, sample, block_size, serial); });
+        if (std::string(serial.begin(), serial.end()) != container) return 1;
+
+        std::ostringstream restored;
+        pipeline.decompress(serial, restored);
+        if (restored.str() != std::string(sample.begin(), sample.end())) return 1;
+
+        std::vector<uint8_t> restored_serial;
+        pool.run(0, 1, [&](const uint64_t worker, uint64_t) { pipeline.decompress_on(worker, serial, restored_serial); });
+        if (!std::ranges::equal(restored_serial, sample)) return 1;
+    }
+
+    // shared dictionaries: same container either way, decoded per group, and smaller on repetitive data
+    for (const uint64_t group_blocks : { 1ul, 3ul, 16ul, 1000ul })
+    {
+        std::ostringstream parallel;
+        pipeline.compress(data, 4095, parallel, group_blocks);
+        const auto container = parallel.str();
+
+        std::vector<uint8_t> serial;
+        pool.run(0, 1, [&](const uint64_t worker, uint64_t) { pipeline.compress_on(worker, data, 4095, serial, group_blocks); });
+        if (std::string(serial.begin(), serial.end()) != container) return 1;
+
+        std::ostringstream restored;
+        pipeline.decompress(serial, restored);
+        if (restored.str() != std::string(data.begin(), data.end())) return 1;
+
+        std::vector<uint8_t> restored_serial;
+        pool.run(0, 1, [&](const uint64_t worker, uint64_t) { pipeline.decompress_on(worker, serial, restored_serial); });
+        if (restored_serial != data) return 1;
+    }
+
+    std::string log;
+    for (uint64_t i = 0; log.size() < 200000; i++) log += "GET /api/v1/items/" + std::to_string(i % 97) + " 200 OK\n";
+    const std::span log_bytes(reinterpret_cast<const uint8_t *>(log.data()), log.size());
+    std::ostringstream independent, grouped;
+    pipeline.compress(log_bytes, 4095, independent);
+    pipeline.compress(log_bytes, 4095, grouped, 16);
+    if (grouped.str().size() >= independent.str().size()) return 1;
+
+    // every level round trips, records itself in the stream header, and the top level beats the bottom one
+    std::vector<uint64_t> level_sizes;
+    for (uint64_t level = 1; level <= lzw::max_compression_level; level++)
+    {
+        const auto settings = lzw::compression_level(level);
+        pipeline.set_selection(settings.selection);
+        pipeline.set_lz77(settings.lz77_mode, settings.lz77_window_log);
+        pipeline.set_reset_policy(settings.reset_policy);
+        pipeline.set_level(level);
+
+        std::ostringstream leveled;
+        pipeline.compress(log_bytes, settings.block_size, leveled, settings.group_blocks);
+        const auto stream = leveled.str();
+        const std::span stream_bytes(reinterpret_cast<const uint8_t *>(stream.data()), stream.size());
+        lzw::stream_header_t header { };
+        if (lzw::read_stream_header(stream_bytes, header) != sizeof(header) || header.level != level
+            || (header.flags & lzw::stream_header_t::HasDictionary))
+        {
+            return 1;
+        }
+
+        std::ostringstream restored;
+        pipeline.decompress(stream_bytes, restored);
+        if (restored.str() != log) return 1;
+        level_sizes.push_back(stream.size());
+    }
+
+    if (level_sizes.back() >= level_sizes.front()) return 1;
+    try {
+        std::ignore = lzw::compression_level(lzw::max_compression_level + 1);
+        return 1;
+    } catch (const std::invalid_argument &) { }
+
+    const auto defaults = lzw::compression_level(0);
+    pipeline.set_selection(defaults.selection);
+    pipeline.set_lz77(defaults.lz77_mode, defaults.lz77_window_log);
+    pipeline.set_reset_policy(defaults.reset_policy);
+    pipeline.set_level(0);
+
+    // empty stream is an empty container
+    std::ostringstream empty;
+    if (pipeline.compress({ }, 4095, empty) != 0 || !empty.str().empty()) return 1;
+
+    // corrupted containers are reported, not written
+    std::ostringstream packed, ignored;
+    pipeline.compress(data, 4095, packed);
+    auto corrupted = packed.str();
+    corrupted.resize(corrupted.size() - 1);
+    try {
+        pipeline.decompress({ reinterpret_cast<const uint8_t *>(corrupted.data()), corrupted.size() }, ignored);
+        return 1;
+    } catch (const std::runtime_error &) { }
+
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include "scheduler.h"
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <stdexcept>
+
+int main()
+{
+    constexpr uint64_t tasks = 10000;
+    lzw::work_stealing_pool pool(4);
+
+    // every task runs exactly once, across several jobs on the same pool
+    std::vector < std::atomic < uint32_t > > runs(tasks);
+    for (int job = 0; job < 3; job++)
+    {
+        pool.run(0, tasks, [&](const uint64_t worker, const uint64_t task)
+        {
+            if (worker >= pool.size()) throw std::logic_error("bad worker");
+            runs[task]++;
+        });
+    }
+
+    for (const auto & count : runs) {
+        if (count != 3) return 1;
+    }
+
+    // one slow range, all of it given to the first worker, is picked apart by the idle workers
+    std::atomic < uint64_t > done(0), slow_workers(0);
+    pool.run(100, 164, [&](const uint64_t worker, const uint64_t task)
+    {
+        if (task < 116) {
+            slow_workers |= 1ull << worker;
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        ++done;
+    });
+    if (done != 64 || std::popcount(slow_workers.load()) < 2) return 1;
+
+    // the first error is rethrown and the pool stays usable
+    try {
+        pool.run(0, tasks, [](uint64_t, const uint64_t task) { if (task == 1234) throw std::runtime_error("task failed"); });
+        return 1;
+    } catch (const std::runtime_error &) { }
+
+    // broadcast reaches every worker exactly once, on its own thread
+    std::vector < std::thread::id > ids(pool.size());
+    pool.for_each_worker([&](const uint64_t worker) { ids[worker] = std::this_thread::get_id(); });
+    for (uint64_t i = 0; i < ids.size(); i++) {
+        for (uint64_t j = i + 1; j < ids.size(); j++) {
+            if (ids[i] == ids[j]) return 1;
+        }
+    }
+
+    done = 0;
+    pool.run(0, 10, [&](uint64_t, uint64_t) { ++done; });
+    pool.run(5, 5, [&](uint64_t, uint64_t) { ++done; });
+    return done == 10 ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+#include "lzw6.h"
+#include <random>
+#include <string>
+#include "cppcrc.h"
+
+/// Strips written by libtiff 4 (TIFFWriteEncodedStrip, COMPRESSION_LZW, 8-bit greyscale)
+static const std::vector<uint8_t> libtiff_strip {
+    0x80, 0x15, 0x09, 0xE4, 0x22, 0x29, 0x3C, 0xA4, 0x4E, 0x27, 0x95,
+    0x20, 0x50, 0x48, 0x34, 0x2E, 0x0B, 0x07, 0x84, 0x88, 0xE0, 0x20,
+};
+static const std::string libtiff_strip_text = "TOBEORNOTTOBEORTOBEORNOT#";
+
+/// Larger strips are checked by size and CRC32 of what libtiff wrote for them
+struct libtiff_reference_t
+{
+    std::vector<uint8_t> image;
+    uint64_t strip_size;
+    uint32_t strip_crc;
+};
+
+/// 8-bit test pattern, width pixels per row
+static std::vector<uint8_t> pattern(const uint64_t size, const uint64_t width)
+{
+    std::vector<uint8_t> image(size);
+    for (uint64_t i = 0; i < size; i++)
+    {
+        const uint64_t x = i % width, y = i / width;
+        image[i] = static_cast<uint8_t>(((x ^ y) * 3 + (x >> 3) + ((x * y) >> 6)) & 0xFF);
+    }
+
+    return image;
+}
+
+int main()
+{
+    // MSB-first packing puts the first code in the high bits of the first byte
+    std::vector<uint8_t> packed, unpacked;
+    lzw::BitWriterMSB writer(packed);
+    writer.write(0b101, 3);
+    writer.write(0x1FF, 9);
+    writer.write(0x0, 4);
+    if (packed != std::vector<uint8_t> { 0xBF, 0xF0 }) return 1;
+
+    std::mt19937_64 rng(0x71FF);
+    std::vector<std::pair<uint64_t, uint64_t>> written;
+    packed.clear();
+    lzw::BitWriterMSB random_writer(packed);
+    for (int i = 0; i < 4096; i++)
+    {
+        const uint64_t width = rng() % 64 + 1;
+        const uint64_t value = rng() & (width == 64 ? UINT64_MAX : (1ULL << width) - 1);
+        random_writer.write(value, width);
+        written.emplace_back(value, width);
+    }
+
+    lzw::BitReaderMSB reader(packed);
+    for (const auto & [value, width] : written) {
+        if (reader.read(width) != value) return 1;
+    }
+
+    // libtiff strips decode, and encoding gives back the very same strips
+    lzw::tiff_lzw tiff;
+    tiff.decompress(libtiff_strip, unpacked);
+    if (std::string(unpacked.begin(), unpacked.end()) != libtiff_strip_text) return 1;
+    tiff.compress({ reinterpret_cast<const uint8_t *>(libtiff_strip_text.data()), libtiff_strip_text.size() }, packed);
+    if (packed != libtiff_strip) return 1;
+
+    const std::vector<libtiff_reference_t> references {
+        { pattern(4096, 64), 3561, 0xA1919985 },                // crosses every code width
+        { std::vector<uint8_t>(100000, 0), 530, 0xFE8924E7 },
+    };
+
+    for (const auto & [image, strip_size, strip_crc] : references)
+    {
+        tiff.compress(image, packed);
+        if (packed.size() != strip_size || CRC32::CRC32::calc(packed.data(), packed.size()) != strip_crc) return 1;
+        tiff.decompress(packed, unpacked);
+        if (unpacked != image) return 1;
+    }
+
+    // the table is cleared before code 4094, long strips keep round tripping
+    for (const auto & image : { pattern(40000, 200), pattern(1 << 17, 512) })
+    {
+        tiff.compress(image, packed);
+        if (tiff.dictionary_resets() == 0) return 1;
+        tiff.decompress(packed, unpacked);
+        if (unpacked != image) return 1;
+    }
+
+    // a strip without EOI decodes up to its last whole code, the container codec insists on EOI
+    tiff.decompress(std::span(libtiff_strip).first(libtiff_strip.size() - 2), unpacked);
+    if (std::string(unpacked.begin(), unpacked.end()) != libtiff_strip_text.substr(0, libtiff_strip_text.size() - 1)) return 1;
+
+    lzw::lzw<12> strict;
+    strict.compress(pattern(4096, 64), packed);
+    try {
+        strict.decompress(std::span(packed).first(packed.size() - 2), unpacked);
+        return 1;
+    } catch (const std::out_of_range &) { }
+
+    // early change streams round trip at every length, including a last code reaching the width threshold
+    lzw::lzw<12, true> early;
+    for (uint64_t size = 1; size < 1200; size++)
+    {
+        std::vector<uint8_t> sample(size);
+        for (auto & byte : sample) byte = static_cast<uint8_t>(rng());
+        early.compress(sample, packed);
+        early.decompress(packed, unpacked);
+        if (unpacked != sample) return 1;
+    }
+
+    return 0;
+}